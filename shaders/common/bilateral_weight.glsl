@@ -0,0 +1,6 @@
+// expects u_depth_sharpness and u_normal_power
+float bilateral_weight(in vec4 center, in vec4 tap) {
+    float depth_weight = exp(-abs(tap.a - center.a) / max(center.a, 0.0001) * u_depth_sharpness);
+    float normal_weight = pow(max(dot(tap.rgb, center.rgb), 0.0), u_normal_power);
+    return depth_weight * normal_weight;
+}
@@ -0,0 +1,4 @@
+layout(std140) uniform cube_transformations {
+    mat4 cube_view_matrices[6];
+    mat4 cube_mvp_matrices[6];
+};
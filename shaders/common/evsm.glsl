@@ -0,0 +1,9 @@
+const vec2 EVSM_EXPONENTS = vec2(5.54, 5.54);
+
+vec4 warp_depth(in float depth) {
+    float d = 2 * depth - 1;
+    float pos = exp(EVSM_EXPONENTS.x * d);
+    float neg = -exp(-EVSM_EXPONENTS.y * d);
+
+    return vec4(pos, pos * pos, neg, neg * neg);
+}
@@ -0,0 +1,9 @@
+struct light {
+    vec4 pos;
+    vec4 color;
+};
+
+layout(std140) uniform light_params {
+    light lights[MAX_LIGHTS];
+    int num_lights;
+};
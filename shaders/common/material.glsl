@@ -0,0 +1,7 @@
+layout(std140) uniform material {
+    vec4 diffuse;
+    vec4 specular;
+    float shininess;
+    float reflectance;
+    int reflection_mode;
+} mtl;
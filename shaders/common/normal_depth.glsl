@@ -0,0 +1,41 @@
+// RGBA16F: octahedral normal in rg (angular error below 0.001 rad), linear depth split into a half-float
+// head in b and the residual in a, in units of the head's ulp so it keeps 11 bits instead of going denormal.
+// The relative depth error stays below 2^-21 for depths from 2^-14 up, which covers everything past near / far.
+// Blending two packed texels gives neither normal nor depth, read them with texelFetch.
+vec2 octahedral_encode(in vec3 normal) {
+    normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+    if (normal.z >= 0.0) return normal.xy;
+
+    return (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+}
+
+float half_ulp(in float depth) {
+    return exp2(floor(log2(max(depth, 0.00006103515625))) - 10.0);
+}
+
+vec2 split_depth(in float depth) {
+    float head = round(depth / half_ulp(depth)) * half_ulp(depth);
+    return vec2(head, (depth - head) / half_ulp(head));
+}
+
+float join_depth(in vec2 split) {
+    return split.x + split.y * half_ulp(split.x);
+}
+
+vec3 octahedral_decode(in vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (normal.z < 0.0) {
+        normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(normal);
+}
+
+vec4 decode_normal_depth(in vec4 encoded) {
+    float depth = join_depth(encoded.ba);
+    return depth > 0.0 ? vec4(octahedral_decode(encoded.rg), depth) : vec4(0.0);
+}
+
+vec4 fetch_normal_depth(in sampler2D map, in vec2 uv) {
+    ivec2 size = textureSize(map, 0);
+    return decode_normal_depth(texelFetch(map, clamp(ivec2(uv * vec2(size)), ivec2(0), size - 1), 0));
+}
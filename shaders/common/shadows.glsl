@@ -0,0 +1,94 @@
+// Shadow lookups of the lights in light_params, needs the transformations block.
+// The first SHADOW_MASK_LIGHTS lights can come from the screen space shadow mask instead.
+
+uniform vec2 u_shadow_rotation = vec2(1.0, 0.0);
+const int SHADOW_MASK_LIGHTS = 4;
+
+#ifndef SHADOW_SAMPLES
+#define SHADOW_SAMPLES 8
+#endif
+uniform float u_shadow_distance = 600.0;
+uniform float u_depth_bias = 0;
+
+uniform sampler2DArrayShadow u_shadow_maps;
+uniform mat4 u_shadow_bias_matrices[MAX_SHADOW_VIEWS];
+uniform vec4 u_shadow_rects[MAX_SHADOW_VIEWS];
+uniform int u_shadow_pages[MAX_SHADOW_VIEWS];
+uniform ivec2 u_light_views[MAX_LIGHTS];
+uniform vec4 u_cascade_splits[MAX_LIGHTS];
+
+uniform int u_shadow_filter = 0;
+uniform sampler2DArray u_shadow_moments;
+uniform float u_evsm_bleed = 0.2;
+#include "evsm.glsl"
+
+#poisson_disk poisson_disk SHADOW_SAMPLES
+
+int shadow_view(in int i, in float view_depth) {
+    int view = u_light_views[i].x;
+    for (int cascade = 0; cascade < u_light_views[i].y - 1; ++cascade) {
+        if (view_depth > u_cascade_splits[i][cascade]) ++view;
+    }
+
+    return view;
+}
+
+vec3 shadow_atlas_coord(in int view, in vec2 uv) {
+    vec4 rect = u_shadow_rects[view];
+    vec2 half_texel = 0.5 / vec2(textureSize(u_shadow_maps, 0).xy);
+
+    return vec3(clamp(rect.xy + uv * rect.zw, rect.xy + half_texel, rect.xy + rect.zw - half_texel),
+        u_shadow_pages[view]);
+}
+
+float shadow_pcf(in int view, in vec3 uvd) {
+    return texture(u_shadow_maps, vec4(shadow_atlas_coord(view, uvd.xy), uvd.z));
+}
+
+float chebyshev_upper_bound(in vec2 moments, in float depth, in float exponent) {
+    float min_variance = 0.0001 * exponent * depth;
+    float variance = max(moments.y - moments.x * moments.x, min_variance * min_variance);
+    float d = depth - moments.x;
+    float p_max = clamp((variance / (variance + d * d) - u_evsm_bleed) / (1 - u_evsm_bleed), 0, 1);
+
+    return depth <= moments.x ? 1.0 : p_max;
+}
+
+float shadow_evsm(in int view, in vec3 uvd) {
+    vec4 moments = texture(u_shadow_moments, shadow_atlas_coord(view, uvd.xy));
+    vec4 warped = warp_depth(uvd.z);
+
+    return min(chebyshev_upper_bound(moments.xy, warped.x, EVSM_EXPONENTS.x),
+        chebyshev_upper_bound(moments.zw, warped.z, -EVSM_EXPONENTS.y));
+}
+
+// cascades split the main camera's frustum, so they are picked by its depth even in the cube map faces
+float shadow_visibility(in int i, in vec3 position_worldspace) {
+    int view = shadow_view(i, -(mv_matrix * vec4(position_worldspace, 1.0)).z);
+    vec4 shadow_coord = u_shadow_bias_matrices[view] * vec4(position_worldspace, 1.0);
+    vec3 shadow_coord_clipspace = shadow_coord.xyz / shadow_coord.w;
+    float visibility = 1.0;
+
+    bool shadowed = u_light_views[i].y > 0;
+    float visibility_per_sample = 0.8 / float(max(SHADOW_SAMPLES, 1));
+    mat2 rotation = mat2(u_shadow_rotation.x, u_shadow_rotation.y, -u_shadow_rotation.y, u_shadow_rotation.x);
+
+    if (shadowed && u_shadow_filter == 0) {
+        for (int sample_idx = 0; sample_idx < SHADOW_SAMPLES; ++sample_idx) {
+            float sampled_shadow = float(shadow_pcf(view,
+                vec3(shadow_coord_clipspace.xy + rotation * poisson_disk[sample_idx] / u_shadow_distance,
+                (shadow_coord.z - u_depth_bias) / shadow_coord.w)));
+
+            visibility -= visibility_per_sample * (1.0 - sampled_shadow);
+        }
+    }
+
+    if (shadowed && u_shadow_filter == 1) {
+        float lit = shadow_evsm(view,
+            vec3(shadow_coord_clipspace.xy, (shadow_coord.z - u_depth_bias) / shadow_coord.w));
+
+        visibility -= 0.8 * (1.0 - lit);
+    }
+
+    return visibility;
+}
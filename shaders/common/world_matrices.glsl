@@ -0,0 +1,11 @@
+// world matrices of the transform hierarchy, four RGBA32F texels per node
+uniform samplerBuffer u_world_matrices;
+uniform int u_node;
+
+mat4 world_matrix(in int node) {
+    return mat4(
+        texelFetch(u_world_matrices, 4 * node),
+        texelFetch(u_world_matrices, 4 * node + 1),
+        texelFetch(u_world_matrices, 4 * node + 2),
+        texelFetch(u_world_matrices, 4 * node + 3));
+}
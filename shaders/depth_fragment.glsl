@@ -1,10 +1,24 @@
 #version 330 core
 
-in vec3 v_normal_eyespace;
-in float v_linear_depth;
+in vertex_data {
+    vec3 v_position;
+    vec3 v_normal;
+    vec2 v_tex_coord;
+    vec3 v_tangent;
+    vec3 v_bitangent;
+    vec3 v_camera_pos_tangentspace;
+    flat float v_layer;
+    flat int v_face;
+};
 
 layout(location = 0) out vec4 normal_and_depth;
 
+#include "common/transformations.glsl"
+#include "common/normal_depth.glsl"
+
+uniform float u_far;
+
 void main() {
-    normal_and_depth = vec4(normalize(v_normal_eyespace), v_linear_depth);
+    float linear_depth = -(mv_matrix * vec4(v_position, 1.0)).z / u_far;
+    normal_and_depth = vec4(octahedral_encode(normalize(normal_matrix * v_normal)), split_depth(linear_depth));
 }
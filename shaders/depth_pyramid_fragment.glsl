@@ -0,0 +1,43 @@
+#version 330 core
+
+layout(location = 0) out vec4 normal_and_depth;
+
+uniform sampler2D u_normal_depth_map;
+
+#include "common/normal_depth.glsl"
+
+vec4 fetch(in ivec2 texel, in ivec2 size) {
+    return texelFetch(u_normal_depth_map, min(texel, size - 1), 0);
+}
+
+void keep_nearest(inout vec4 nearest, in vec4 candidate) {
+    float nearest_depth = join_depth(nearest.ba);
+    float candidate_depth = join_depth(candidate.ba);
+    if (nearest_depth <= 0.0) nearest_depth = 2.0;
+    if (candidate_depth <= 0.0) candidate_depth = 2.0;
+    if (candidate_depth < nearest_depth) nearest = candidate;
+}
+
+void main() {
+    ivec2 size = textureSize(u_normal_depth_map, 0);
+    ivec2 base = 2 * ivec2(gl_FragCoord.xy);
+
+    vec4 nearest = fetch(base, size);
+    keep_nearest(nearest, fetch(base + ivec2(1, 0), size));
+    keep_nearest(nearest, fetch(base + ivec2(0, 1), size));
+    keep_nearest(nearest, fetch(base + ivec2(1, 1), size));
+
+    bool odd_width = (size.x & 1) != 0;
+    bool odd_height = (size.y & 1) != 0;
+    if (odd_width) {
+        keep_nearest(nearest, fetch(base + ivec2(2, 0), size));
+        keep_nearest(nearest, fetch(base + ivec2(2, 1), size));
+    }
+    if (odd_height) {
+        keep_nearest(nearest, fetch(base + ivec2(0, 2), size));
+        keep_nearest(nearest, fetch(base + ivec2(1, 2), size));
+    }
+    if (odd_width && odd_height) keep_nearest(nearest, fetch(base + ivec2(2, 2), size));
+
+    normal_and_depth = nearest;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+layout(location = 0) out vec4 normal_and_depth;
+
+uniform sampler2DMS u_normal_depth_map;
+uniform vec2 u_target_size;
+
+// the first sample of the full resolution pixel under the texel center, blending would break the packing
+void main() {
+    ivec2 size = textureSize(u_normal_depth_map);
+    ivec2 texel = ivec2(gl_FragCoord.xy * vec2(size) / u_target_size);
+    normal_and_depth = texelFetch(u_normal_depth_map, min(texel, size - 1), 0);
+}
@@ -7,19 +7,32 @@ in vec2 v_tex_coord;
 layout(location = 0) out float blurred;
 
 uniform sampler2D u_sampler;
-uniform float u_size;
+uniform sampler2D u_normal_depth_map;
+uniform float u_size = 1.0;
+uniform float u_depth_sharpness = 32.0;
+uniform float u_normal_power = 8.0;
+
+const float weights[5] = float[](0.16, 0.15, 0.12, 0.09, 0.05);
+
+#include "common/normal_depth.glsl"
+#include "common/bilateral_weight.glsl"
 
 void main() {
-    float sum = 0.0;
-    sum += texture(u_sampler, vec2(v_tex_coord.x - 4 * u_size, v_tex_coord.y)).r * 0.05;
-    sum += texture(u_sampler, vec2(v_tex_coord.x - 3 * u_size, v_tex_coord.y)).r * 0.09;
-    sum += texture(u_sampler, vec2(v_tex_coord.x - 2 * u_size, v_tex_coord.y)).r * 0.12;
-    sum += texture(u_sampler, vec2(v_tex_coord.x - 1 * u_size, v_tex_coord.y)).r * 0.15;
-    sum += texture(u_sampler, vec2(v_tex_coord.x - 0 * u_size, v_tex_coord.y)).r * 0.16;
-    sum += texture(u_sampler, vec2(v_tex_coord.x + 1 * u_size, v_tex_coord.y)).r * 0.15;
-    sum += texture(u_sampler, vec2(v_tex_coord.x + 2 * u_size, v_tex_coord.y)).r * 0.12;
-    sum += texture(u_sampler, vec2(v_tex_coord.x + 3 * u_size, v_tex_coord.y)).r * 0.09;
-    sum += texture(u_sampler, vec2(v_tex_coord.x + 4 * u_size, v_tex_coord.y)).r * 0.05;
-
-    blurred = sum;
+    vec2 texel_step = vec2(u_size / float(textureSize(u_sampler, 0).x), 0.0);
+    vec4 center = fetch_normal_depth(u_normal_depth_map, v_tex_coord);
+
+    float sum = texture(u_sampler, v_tex_coord).r * weights[0];
+    float total = weights[0];
+
+    for (int i = 1; i < 5; ++i) {
+        for (int side = -1; side <= 1; side += 2) {
+            vec2 tex_coord = v_tex_coord + float(side * i) * texel_step;
+            float weight = weights[i] * bilateral_weight(center, fetch_normal_depth(u_normal_depth_map, tex_coord));
+
+            sum += texture(u_sampler, tex_coord).r * weight;
+            total += weight;
+        }
+    }
+
+    blurred = sum / total;
 }
@@ -2,146 +2,271 @@
 
 precision mediump float;
 
-in vec3 v_position;
-in vec3 v_normal;
-in vec2 v_tex_coord;
-in vec3 v_tangent;
-in vec3 v_bitangent;
-in vec3 v_camera_pos_tangentspace;
-
-layout(location = 0) out vec4 frag_color;
-
-layout(std140) uniform transformations {
-    mat4 depth_bias_matrix;
-    mat4 mv_matrix;
-    mat4 mvp_matrix;
-    mat4 projection_matrix;
-    mat3 normal_matrix;
-};
-
-struct light {
-    vec4 pos;
-    vec4 color;
+in vertex_data {
+    vec3 v_position;
+    vec3 v_normal;
+    vec2 v_tex_coord;
+    vec3 v_tangent;
+    vec3 v_bitangent;
+    vec3 v_camera_pos_tangentspace;
+    flat float v_layer;
+    flat int v_face;
 };
 
-const int MAX_LIGHTS = 8;
-layout(std140) uniform light_params {
-    light lights[MAX_LIGHTS];
-    int num_lights;
-};
+layout(location = 0) out vec4 frag_color;
 
-layout(std140) uniform material {
-    vec4 diffuse;
-    vec4 specular;
-    float shininess;
-    float reflectance;
-} mtl;
+#include "common/transformations.glsl"
+#include "common/cube_transformations.glsl"
+#include "common/light_params.glsl"
+#include "common/material.glsl"
 
-uniform bool u_diffuse_textured = false;
-uniform bool u_normal_textured = false;
+uniform bool u_instanced;
+uniform bool u_layered;
+uniform bool u_overdraw = false;
 
 uniform sampler2D u_diffuse_map;
+uniform sampler2DArray u_diffuse_array;
 uniform sampler2D u_normal_map;
 uniform sampler2D u_height_map;
 uniform sampler2D u_occlusion_map;
+uniform sampler2D u_normal_depth_map;
+uniform sampler2D u_shadow_mask;
 uniform samplerCube u_reflection_map;
+uniform sampler2D u_scene_color;
 
 uniform vec3 u_camera_pos_worldspace;
 uniform float u_parallax_scale = 0.005;
 uniform float u_parallax_bias = 0.0;
 
-uniform int u_shadow_samples = 8;
-uniform float u_shadow_distance = 600.0;
-uniform float u_depth_bias = 0;
-
-uniform sampler2DShadow u_shadow_maps[MAX_LIGHTS];
-uniform mat4 u_shadow_bias_matrices[MAX_LIGHTS];
-
-const vec2 poisson_disk[16] = vec2[](
-    vec2(-0.94201624, -0.39906216),
-    vec2(0.94558609, -0.76890725),
-    vec2(-0.094184101, -0.92938870),
-    vec2(0.34495938, 0.29387760),
-    vec2(-0.91588581, 0.45771432),
-    vec2(-0.81544232, -0.87912464),
-    vec2(-0.38277543, 0.27676845),
-    vec2(0.97484398, 0.75648379),
-    vec2(0.44323325, -0.97511554),
-    vec2(0.53742981, -0.47373420),
-    vec2(-0.26496911, -0.41893023),
-    vec2(0.79197514, 0.19090188),
-    vec2(-0.24188840, 0.99706507),
-    vec2(-0.81409955, 0.91437590),
-    vec2(0.19984126, 0.78641367),
-    vec2(0.14383161, -0.14100790)
-);
+const int REFLECTION_SSR = 1;
+const int SSR_MAX_STEPS = 64;
+const int SSR_MAX_LEVEL = 6;
+uniform mat4 u_reprojection_matrix;
+uniform float u_near = 0.1;
+uniform float u_far = 100.0;
+uniform float u_ssr_max_distance = 5.0;
+uniform float u_ssr_thickness = 0.002;
+
+uniform float u_upsample_depth_sharpness = 32.0;
+uniform float u_upsample_normal_power = 8.0;
+
+const ivec3 CLUSTER_GRID = ivec3(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z);
+uniform bool u_clustered = false;
+uniform vec2 u_cluster_scale;
+uniform usamplerBuffer u_cluster_grid;
+uniform usamplerBuffer u_cluster_indices;
+uniform samplerBuffer u_point_lights;
 
+uniform bool u_shadow_mask_enabled = false;
+
+#include "common/shadows.glsl"
+
+mat4 eye_matrix() {
+    return u_layered ? cube_view_matrices[v_face] : mv_matrix;
+}
 
 vec3 transform_and_dehomogenize(in vec3 original) {
-    vec4 transformed = mv_matrix * vec4(original, 1);
+    vec4 transformed = eye_matrix() * vec4(original, 1);
     return transformed.xyz / transformed.w;
 }
 
-float shadow_pcf(in int i, in vec3 uvd) {
-    if (i == 0) return texture(u_shadow_maps[0], uvd);
-    else if (i == 1) return texture(u_shadow_maps[1], uvd);
-    else if (i == 2) return texture(u_shadow_maps[2], uvd);
-    else if (i == 3) return texture(u_shadow_maps[3], uvd);
-    else if (i == 4) return texture(u_shadow_maps[4], uvd);
-    else if (i == 5) return texture(u_shadow_maps[5], uvd);
-    else if (i == 6) return texture(u_shadow_maps[6], uvd);
-    else if (i == 7) return texture(u_shadow_maps[7], uvd);
+vec3 project_to_screen(in vec3 position) {
+    vec4 clip = projection_matrix * vec4(position, 1);
+    return vec3(clip.xy / clip.w * 0.5 + 0.5, -position.z / u_far);
+}
+
+#include "common/normal_depth.glsl"
+
+vec4 pyramid_fetch(in vec2 uv, in int level) {
+    ivec2 size = textureSize(u_normal_depth_map, level);
+    return decode_normal_depth(texelFetch(u_normal_depth_map, clamp(ivec2(uv * vec2(size)), ivec2(0), size - 1), level));
+}
+
+vec3 unproject_from_screen(in vec2 uv) {
+    float depth = pyramid_fetch(uv, 0).a * u_far;
+    return vec3((uv * 2 - 1) * depth / vec2(projection_matrix[0][0], projection_matrix[1][1]), -depth);
+}
+
+bool trace_screen_space(in vec3 origin, in vec3 dir, out vec2 hit_uv) {
+    hit_uv = vec2(0);
+
+    float distance = u_ssr_max_distance;
+    if (dir.z > 0) distance = min(distance, 0.99 * (-u_near - origin.z) / dir.z);
+
+    vec3 start = project_to_screen(origin);
+    vec3 end = project_to_screen(origin + distance * dir);
+
+    ivec2 size = textureSize(u_normal_depth_map, 0);
+    vec2 delta = (end.xy - start.xy) * vec2(size);
+    float pixels = max(abs(delta.x), abs(delta.y));
+    if (pixels < 1) return false;
+
+    int max_level = min(SSR_MAX_LEVEL, int(log2(float(max(size.x, size.y)))));
+
+    int level = 0;
+    float t = 1;
+    for (int i = 0; i < SSR_MAX_STEPS; ++i) {
+        float next_t = t + exp2(float(level));
+        if (next_t > pixels) {
+            if (level == 0) return false;
+            --level;
+            continue;
+        }
+
+        float s = next_t / pixels;
+        vec2 uv = mix(start.xy, end.xy, s);
+        if (any(lessThan(uv, vec2(0))) || any(greaterThan(uv, vec2(1)))) return false;
+
+        float ray_depth = 1 / mix(1 / start.z, 1 / end.z, s);
+        float scene_depth = pyramid_fetch(uv, level).a;
+
+        if (ray_depth < scene_depth) {
+            t = next_t;
+            level = min(level + 1, max_level);
+        } else if (level > 0) {
+            --level;
+        } else if (ray_depth - scene_depth < u_ssr_thickness) {
+            hit_uv = uv;
+            return true;
+        } else {
+            t = next_t;
+        }
+    }
+
+    return false;
+}
+
+vec4 sample_reflection(in vec3 position, in vec3 normal) {
+    if (u_layered || mtl.reflection_mode != REFLECTION_SSR) return texture(u_reflection_map, v_normal);
+
+    vec3 dir = reflect(normalize(position), normal);
+    vec4 fallback = texture(u_reflection_map, transpose(mat3(eye_matrix())) * dir);
+
+    vec2 hit_uv;
+    if (!trace_screen_space(position, dir, hit_uv)) return fallback;
+
+    vec4 previous = u_reprojection_matrix * vec4(unproject_from_screen(hit_uv), 1);
+    vec2 previous_uv = previous.xy / previous.w * 0.5 + 0.5;
+    vec2 edge = min(previous_uv, 1 - previous_uv);
+    float fade = clamp(10 * min(edge.x, edge.y), 0, 1);
+
+    return mix(fallback, textureLod(u_scene_color, previous_uv, 0), fade);
+}
+
+vec4 upsample(in sampler2D map, in vec2 tex_coord, in vec3 normal, in float linear_depth) {
+    ivec2 size = textureSize(map, 0);
+    vec2 texel = tex_coord * vec2(size) - 0.5;
+    vec2 f = fract(texel);
+    ivec2 base = ivec2(floor(texel));
+
+    vec4 sum = vec4(0.0);
+    float total = 0.0;
+
+    for (int i = 0; i < 4; ++i) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 coord = clamp(base + offset, ivec2(0), size - 1);
+        vec4 tap = decode_normal_depth(texelFetch(u_normal_depth_map, coord, 0));
+
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y *
+            exp(-abs(tap.a - linear_depth) / linear_depth * u_upsample_depth_sharpness) *
+            pow(max(dot(tap.rgb, normal), 0.0), u_upsample_normal_power);
+
+        sum += texelFetch(map, coord, 0) * weight;
+        total += weight;
+    }
+
+    return total > 0.0001 ? sum / total : texture(map, tex_coord);
+}
+
+vec4 shade_point_lights(vec3 pos_eyespace, vec3 normal, vec3 eye_dir, vec4 diffuse) {
+    ivec2 tile = ivec2(gl_FragCoord.xy * u_cluster_scale);
+    int slice = int(log(-pos_eyespace.z / u_near) / log(u_far / u_near) * CLUSTER_GRID.z);
+    ivec3 cluster = clamp(ivec3(tile, slice), ivec3(0), CLUSTER_GRID - 1);
+    uvec2 range = texelFetch(u_cluster_grid, (cluster.z * CLUSTER_GRID.y + cluster.y) * CLUSTER_GRID.x + cluster.x).rg;
+
+    vec4 color = vec4(0);
+    for (uint i = 0u; i < range.y; ++i) {
+        int index = int(texelFetch(u_cluster_indices, int(range.x + i)).r);
+        vec4 pos_radius = texelFetch(u_point_lights, 2 * index);
+        vec4 light_color = texelFetch(u_point_lights, 2 * index + 1);
+
+        vec3 to_light = pos_radius.xyz - pos_eyespace;
+        float distance_sq = dot(to_light, to_light);
+        float window = clamp(1.0 - distance_sq * distance_sq / pow(pos_radius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (distance_sq + 1.0);
+
+        vec3 light_dir = to_light * inversesqrt(distance_sq);
+        vec3 half_vec = normalize(light_dir + eye_dir);
+
+        color += attenuation * diffuse * light_color * max(dot(normal, light_dir), 0);
+        if (mtl.shininess > 0) {
+            color += attenuation * mtl.specular * light_color * pow(max(dot(normal, half_vec), 0), mtl.shininess);
+        }
+    }
+
+    return color;
 }
 
 void main() {
-    vec2 tex_coord = v_tex_coord;
-    if (u_normal_textured) {
-        float height = texture(u_height_map, v_tex_coord).r;
-        float v = height * u_parallax_scale - u_parallax_bias;
-        tex_coord += normalize(v_camera_pos_tangentspace).xy * v;
+    if (u_overdraw) {
+        frag_color = vec4(0.25, 0.125, 0.0625, 1.0);
+        return;
     }
 
+    vec2 tex_coord = v_tex_coord;
+#ifdef NORMAL_TEXTURED
+    float height = texture(u_height_map, v_tex_coord).r;
+    float v = height * u_parallax_scale - u_parallax_bias;
+    tex_coord += normalize(v_camera_pos_tangentspace).xy * v;
+#endif
+
     const vec3 eye_position = vec3(0, 0, 0);
 
-    vec4 diffuse = mtl.diffuse + (u_diffuse_textured ? texture(u_diffuse_map, vec2(1.0, 1.0) - tex_coord) : vec4(0));
-    if (mtl.reflectance > 0) {
-        diffuse = (1 - mtl.reflectance) * diffuse + mtl.reflectance * texture(u_reflection_map, v_normal);
-    }
+    vec4 diffuse_sample = vec4(0);
+#ifdef DIFFUSE_TEXTURED
+    diffuse_sample = u_instanced
+        ? texture(u_diffuse_array, vec3(vec2(1.0, 1.0) - tex_coord, v_layer))
+        : texture(u_diffuse_map, vec2(1.0, 1.0) - tex_coord);
+#endif
+
+    vec4 diffuse = mtl.diffuse + diffuse_sample;
     vec3 pos_dehomognized = transform_and_dehomogenize(v_position);
     vec3 eye_dir = normalize(eye_position - pos_dehomognized);
     vec3 normal;
+    mat3 eye_normal_matrix = u_layered ? mat3(cube_view_matrices[v_face]) : normal_matrix;
 
-    if (u_normal_textured) {
-        mat3 tbn_matrix = mat3(v_tangent, v_bitangent, v_normal);
-        vec3 normal_tangentspace = texture(u_normal_map, tex_coord).rgb * 2.0 - 1.0;
-        normal = normalize(normal_matrix * tbn_matrix * normal_tangentspace);
-    } else {
-        normal = normalize(normal_matrix * v_normal);
-    }
+#ifdef NORMAL_TEXTURED
+    mat3 tbn_matrix = mat3(v_tangent, v_bitangent, v_normal);
+    vec3 normal_tangentspace = texture(u_normal_map, tex_coord).rgb * 2.0 - 1.0;
+    normal = normalize(eye_normal_matrix * tbn_matrix * normal_tangentspace);
+#else
+    normal = normalize(eye_normal_matrix * v_normal);
+#endif
+
+#ifdef REFLECTIVE
+    diffuse = (1 - mtl.reflectance) * diffuse + mtl.reflectance * sample_reflection(pos_dehomognized, normal);
+#endif
 
     vec4 color = diffuse * 0.3;
 
     vec4 tmp = mvp_matrix * vec4(v_position, 1);
-    float occlusion = texture(u_occlusion_map, tmp.xy / tmp.w * 0.5 + 0.5).r;
+    vec2 screen_coord = tmp.xy / tmp.w * 0.5 + 0.5;
+    vec3 geometric_normal = normalize(eye_normal_matrix * v_normal);
+    float linear_depth = -pos_dehomognized.z / u_far;
 
-    float visibility_per_sample = 0.8 / u_shadow_samples;
+    float occlusion = u_layered ? 1.0 : upsample(u_occlusion_map, screen_coord, geometric_normal, linear_depth).r;
+    bool use_shadow_mask = u_shadow_mask_enabled && !u_layered;
+    vec4 shadow_mask = use_shadow_mask ? upsample(u_shadow_mask, screen_coord, geometric_normal, linear_depth) : vec4(1.0);
 
     for (int i = 0; i < num_lights; ++i) {
-        vec4 shadow_coord = u_shadow_bias_matrices[i] * vec4(v_position, 1.0);
-        vec3 shadow_coord_clipspace = shadow_coord.xyz / shadow_coord.w;
-        float visibility = 1.0;
-
-        for (int sample_idx = 0; sample_idx < u_shadow_samples; ++sample_idx) {
-            int index = sample_idx;
+        float visibility = use_shadow_mask && i < SHADOW_MASK_LIGHTS
+            ? shadow_mask[i]
+            : shadow_visibility(i, v_position);
 
-            float sampled_shadow = float(shadow_pcf(i,
-                vec3(shadow_coord_clipspace.xy + poisson_disk[index] / u_shadow_distance,
-                (shadow_coord.z - u_depth_bias) / shadow_coord.w)));
-
-            visibility -= visibility_per_sample * (1.0 - sampled_shadow);
-        }
-
-        vec3 light_dir = normalize(transform_and_dehomogenize(lights[i].pos.xyz) - pos_dehomognized);
+        vec3 light_dir = lights[i].pos.w == 0
+            ? normalize(mat3(eye_matrix()) * lights[i].pos.xyz)
+            : normalize(transform_and_dehomogenize(lights[i].pos.xyz) - pos_dehomognized);
         vec3 half_vec = normalize(light_dir + eye_dir);
 
         color += visibility * diffuse * lights[i].color * max(dot(normal, light_dir), 0);
@@ -150,5 +275,7 @@ void main() {
         }
     }
 
+    if (u_clustered && !u_layered) color += shade_point_lights(pos_dehomognized, normal, eye_dir, diffuse);
+
     frag_color = color * occlusion;
 }
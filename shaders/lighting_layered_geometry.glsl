@@ -0,0 +1,44 @@
+#version 330 core
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+in vertex_data {
+    vec3 v_position;
+    vec3 v_normal;
+    vec2 v_tex_coord;
+    vec3 v_tangent;
+    vec3 v_bitangent;
+    vec3 v_camera_pos_tangentspace;
+    flat float v_layer;
+    flat int v_face;
+} vertex_in[];
+
+out vertex_data {
+    vec3 v_position;
+    vec3 v_normal;
+    vec2 v_tex_coord;
+    vec3 v_tangent;
+    vec3 v_bitangent;
+    vec3 v_camera_pos_tangentspace;
+    flat float v_layer;
+    flat int v_face;
+} vertex_out;
+
+void main() {
+    for (int i = 0; i < 3; ++i) {
+        gl_Layer = vertex_in[i].v_face;
+        gl_Position = gl_in[i].gl_Position;
+        vertex_out.v_position = vertex_in[i].v_position;
+        vertex_out.v_normal = vertex_in[i].v_normal;
+        vertex_out.v_tex_coord = vertex_in[i].v_tex_coord;
+        vertex_out.v_tangent = vertex_in[i].v_tangent;
+        vertex_out.v_bitangent = vertex_in[i].v_bitangent;
+        vertex_out.v_camera_pos_tangentspace = vertex_in[i].v_camera_pos_tangentspace;
+        vertex_out.v_layer = vertex_in[i].v_layer;
+        vertex_out.v_face = vertex_in[i].v_face;
+        EmitVertex();
+    }
+
+    EndPrimitive();
+}
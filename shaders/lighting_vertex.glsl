@@ -5,36 +5,49 @@ layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 tex_coord;
 layout(location = 3) in vec3 tangent;
 layout(location = 4) in vec3 bitangent;
+layout(location = 5) in mat4 instance_model;
+layout(location = 9) in float instance_layer;
 
-out vec3 v_position;
-out vec3 v_normal;
-out vec2 v_tex_coord;
-out vec3 v_tangent;
-out vec3 v_bitangent;
-out vec3 v_camera_pos_tangentspace;
-
-layout(std140) uniform transformations {
-    mat4 depth_bias_matrix;
-    mat4 mv_matrix;
-    mat4 mvp_matrix;
-    mat4 projection_matrix;
-    mat3 normal_matrix;
+out vertex_data {
+    vec3 v_position;
+    vec3 v_normal;
+    vec2 v_tex_coord;
+    vec3 v_tangent;
+    vec3 v_bitangent;
+    vec3 v_camera_pos_tangentspace;
+    flat float v_layer;
+    flat int v_face;
 };
 
-uniform bool u_normal_textured;
+#include "common/transformations.glsl"
+#include "common/cube_transformations.glsl"
+#include "common/world_matrices.glsl"
+
+invariant gl_Position;
+
+uniform bool u_instanced;
+uniform bool u_layered;
+uniform int u_faces[6];
+uniform int u_face_count;
 uniform vec3 u_camera_pos_worldspace;
 
 void main() {
-    gl_Position = mvp_matrix * vec4(position, 1);
+    mat4 model = u_instanced ? instance_model : world_matrix(u_node);
+    mat3 model_rotation = mat3(model);
+    vec3 position_worldspace = (model * vec4(position, 1)).xyz;
+
+    v_face = u_layered ? u_faces[gl_InstanceID % u_face_count] : 0;
+    gl_Position = (u_layered ? cube_mvp_matrices[v_face] : mvp_matrix) * vec4(position_worldspace, 1);
 
-    v_position = position;
-    v_normal = normal;
+    v_position = position_worldspace;
+    v_normal = model_rotation * normal;
     v_tex_coord = tex_coord;
-    v_tangent = tangent;
-    v_bitangent = bitangent;
+    v_tangent = model_rotation * tangent;
+    v_bitangent = model_rotation * bitangent;
+    v_layer = instance_layer;
 
-    if (u_normal_textured) {
-        mat3 tbn_matrix = mat3(v_tangent, v_bitangent, v_normal);
-        v_camera_pos_tangentspace = transpose(tbn_matrix) * (u_camera_pos_worldspace - position);
-    }
+#ifdef NORMAL_TEXTURED
+    mat3 tbn_matrix = mat3(v_tangent, v_bitangent, v_normal);
+    v_camera_pos_tangentspace = transpose(tbn_matrix) * (u_camera_pos_worldspace - position_worldspace);
+#endif
 }
@@ -0,0 +1,156 @@
+#version 430 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(r8, binding = 0) uniform writeonly image2D u_occlusion_image;
+
+uniform sampler2D u_noise_map;
+uniform sampler2D u_normal_depth_map;
+
+#ifndef SAMPLE_COUNT
+#define SAMPLE_COUNT 16
+#endif
+uniform float u_total_strength = 1.5;
+uniform float u_strength = 0.15;
+uniform float u_offset = 30.0;
+uniform vec2 u_noise_offset = vec2(0.0);
+uniform float u_falloff = 0.000002;
+uniform float u_radius = 0.001;
+uniform float u_depth_bias = 0.005;
+uniform bool u_mip_sampling = true;
+uniform float u_depth_sharpness = 32.0;
+uniform float u_normal_power = 8.0;
+
+const int TILE_SIZE = 16;
+const int BLUR_RADIUS = 4;
+const int AO_SIZE = TILE_SIZE + 2 * BLUR_RADIUS;
+const int CACHE_APRON = BLUR_RADIUS + 4;
+const int CACHE_SIZE = TILE_SIZE + 2 * CACHE_APRON;
+const int THREAD_COUNT = TILE_SIZE * TILE_SIZE;
+const int LOG_MAX_OFFSET = 3;
+const int MAX_MIP_LEVEL = 5;
+
+shared vec4 normal_depth_cache[CACHE_SIZE * CACHE_SIZE];
+shared float occlusion_cache[AO_SIZE * AO_SIZE];
+shared float hblur_cache[TILE_SIZE * AO_SIZE];
+
+#poisson_sphere poisson_sphere SAMPLE_COUNT
+
+const float blur_weights[BLUR_RADIUS + 1] = float[](0.16, 0.15, 0.12, 0.09, 0.05);
+
+ivec2 map_size;
+ivec2 cache_origin;
+
+#include "common/normal_depth.glsl"
+
+vec4 fetch_normal_depth(in ivec2 texel) {
+    ivec2 local = texel - cache_origin;
+    if (all(greaterThanEqual(local, ivec2(0))) && all(lessThan(local, ivec2(CACHE_SIZE)))) {
+        return normal_depth_cache[local.y * CACHE_SIZE + local.x];
+    }
+
+    return decode_normal_depth(texelFetch(u_normal_depth_map, clamp(texel, ivec2(0), map_size - 1), 0));
+}
+
+float occlusion_at(in ivec2 texel) {
+    vec4 current_sample = fetch_normal_depth(texel);
+    float current_depth = current_sample.a;
+    if (SAMPLE_COUNT == 0 || current_depth <= 0.0) return 1.0;
+
+    vec2 tex_coord = (vec2(texel) + 0.5) / vec2(map_size);
+    vec3 random_normal = normalize(textureLod(u_noise_map, tex_coord * u_offset + u_noise_offset, 0.0).rgb * 2.0 - 1.0);
+
+    vec3 ep = vec3(tex_coord, current_depth);
+    vec3 current_normal = current_sample.rgb;
+
+    float bl = 0.0;
+    float radius_d = u_radius / current_depth;
+    int max_level = u_mip_sampling ? min(MAX_MIP_LEVEL, int(log2(float(max(map_size.x, map_size.y))))) : 0;
+
+    for (int i = 0; i < SAMPLE_COUNT; ++i) {
+        vec3 ray = radius_d * reflect(poisson_sphere[i], random_normal);
+
+        vec3 se = ep + sign(dot(ray, current_normal)) * ray;
+
+        ivec2 occluder_texel = ivec2(floor(se.xy * vec2(map_size)));
+        int level = clamp(int(log2(max(distance(vec2(occluder_texel), vec2(texel)), 1.0))) - LOG_MAX_OFFSET, 0, max_level);
+
+        vec4 occluder_sample = level == 0
+            ? fetch_normal_depth(occluder_texel)
+            : decode_normal_depth(texelFetch(u_normal_depth_map,
+                clamp(occluder_texel >> level, ivec2(0), max(map_size >> level, ivec2(1)) - 1), level));
+
+        float depth_diff = current_depth - occluder_sample.a;
+        if (depth_diff > u_depth_bias) continue;
+
+        float norm_diff = 1 - dot(occluder_sample.rgb, current_normal);
+
+        bl += step(u_falloff, depth_diff) * norm_diff * (1.0 - smoothstep(u_falloff, u_strength, depth_diff));
+    }
+
+    return 1.0 - u_total_strength * bl / float(SAMPLE_COUNT);
+}
+
+#include "common/bilateral_weight.glsl"
+
+void main() {
+    map_size = imageSize(u_occlusion_image);
+
+    ivec2 tile_origin = ivec2(gl_WorkGroupID.xy) * TILE_SIZE;
+    ivec2 ao_origin = tile_origin - BLUR_RADIUS;
+    cache_origin = tile_origin - CACHE_APRON;
+    int thread = int(gl_LocalInvocationIndex);
+
+    for (int i = thread; i < CACHE_SIZE * CACHE_SIZE; i += THREAD_COUNT) {
+        ivec2 texel = cache_origin + ivec2(i % CACHE_SIZE, i / CACHE_SIZE);
+        normal_depth_cache[i] = decode_normal_depth(texelFetch(u_normal_depth_map, clamp(texel, ivec2(0), map_size - 1), 0));
+    }
+
+    memoryBarrierShared();
+    barrier();
+
+    for (int i = thread; i < AO_SIZE * AO_SIZE; i += THREAD_COUNT) {
+        occlusion_cache[i] = occlusion_at(ao_origin + ivec2(i % AO_SIZE, i / AO_SIZE));
+    }
+
+    memoryBarrierShared();
+    barrier();
+
+    for (int i = thread; i < TILE_SIZE * AO_SIZE; i += THREAD_COUNT) {
+        ivec2 ao_local = ivec2(i % TILE_SIZE + BLUR_RADIUS, i / TILE_SIZE);
+        vec4 center = fetch_normal_depth(ao_origin + ao_local);
+
+        float sum = 0.0;
+        float total = 0.0;
+        for (int offset = -BLUR_RADIUS; offset <= BLUR_RADIUS; ++offset) {
+            float weight = blur_weights[abs(offset)] *
+                bilateral_weight(center, fetch_normal_depth(ao_origin + ao_local + ivec2(offset, 0)));
+
+            sum += occlusion_cache[ao_local.y * AO_SIZE + ao_local.x + offset] * weight;
+            total += weight;
+        }
+
+        hblur_cache[i] = total > 0.0 ? sum / total : occlusion_cache[ao_local.y * AO_SIZE + ao_local.x];
+    }
+
+    memoryBarrierShared();
+    barrier();
+
+    ivec2 local = ivec2(gl_LocalInvocationID.xy);
+    ivec2 texel = tile_origin + local;
+    if (any(greaterThanEqual(texel, map_size))) return;
+
+    vec4 center = fetch_normal_depth(texel);
+
+    float sum = 0.0;
+    float total = 0.0;
+    for (int offset = -BLUR_RADIUS; offset <= BLUR_RADIUS; ++offset) {
+        float weight = blur_weights[abs(offset)] * bilateral_weight(center, fetch_normal_depth(texel + ivec2(0, offset)));
+
+        sum += hblur_cache[(local.y + BLUR_RADIUS + offset) * TILE_SIZE + local.x] * weight;
+        total += weight;
+    }
+
+    float occlusion = total > 0.0 ? sum / total : hblur_cache[(local.y + BLUR_RADIUS) * TILE_SIZE + local.x];
+    imageStore(u_occlusion_image, texel, vec4(occlusion));
+}
@@ -9,42 +9,36 @@ layout(location = 0) out float occlusion;
 uniform sampler2D u_noise_map;
 uniform sampler2D u_normal_depth_map;
 
-uniform int u_sample_count = 16;
+#ifndef SAMPLE_COUNT
+#define SAMPLE_COUNT 16
+#endif
 uniform float u_total_strength = 1.5;
 uniform float u_strength = 0.15;
 uniform float u_offset = 30.0;
+uniform vec2 u_noise_offset = vec2(0.0);
 uniform float u_falloff = 0.000002;
 uniform float u_radius = 0.001;
 uniform float u_depth_bias = 0.005;
+uniform bool u_mip_sampling = true;
 
-const vec3 poisson_sphere[16] = vec3[](
-    vec3(0.53812504, 0.18565957, -0.43192),
-    vec3(0.13790712, 0.24864247, 0.44301823),
-    vec3(0.33715037, 0.56794053, -0.005789503),
-    vec3(-0.6999805, -0.04511441, -0.0019965635),
-    vec3(0.06896307, -0.15983082, -0.85477847),
-    vec3(0.056099437, 0.006954967, -0.1843352),
-    vec3(-0.014653638, 0.14027752, 0.0762037),
-    vec3(0.010019933, -0.1924225, -0.034443386),
-    vec3(-0.35775623, -0.5301969, -0.43581226),
-    vec3(-0.3169221, 0.106360726, 0.015860917),
-    vec3(0.010350345, -0.58698344, 0.0046293875),
-    vec3(-0.08972908, -0.49408212, 0.3287904),
-    vec3(0.7119986, -0.0154690035, -0.09183723),
-    vec3(-0.053382345, 0.059675813, -0.5411899),
-    vec3(0.035267662, -0.063188605, 0.54602677),
-    vec3(-0.47761092, 0.2847911, -0.0271716)
-);
+const int LOG_MAX_OFFSET = 3;
+const int MAX_MIP_LEVEL = 5;
+
+#poisson_sphere poisson_sphere SAMPLE_COUNT
+
+#include "common/normal_depth.glsl"
 
 void main() {
-    if (u_sample_count == 0) {
+    if (SAMPLE_COUNT == 0) {
         occlusion = 1.0;
         return;
     }
 
-    vec3 random_normal = normalize(texture(u_noise_map, v_tex_coord * u_offset).rgb * 2.0 - 1.0);
+    vec3 random_normal = normalize(texture(u_noise_map, v_tex_coord * u_offset + u_noise_offset).rgb * 2.0 - 1.0);
 
-    vec4 current_sample = texture(u_normal_depth_map, v_tex_coord);
+    vec4 current_sample = fetch_normal_depth(u_normal_depth_map, v_tex_coord);
+    ivec2 size = textureSize(u_normal_depth_map, 0);
+    int max_level = u_mip_sampling ? min(MAX_MIP_LEVEL, int(log2(float(max(size.x, size.y))))) : 0;
     float current_depth = current_sample.a;
 
     vec3 ep = vec3(v_tex_coord, current_depth);
@@ -53,12 +47,16 @@ void main() {
     float bl = 0.0;
     float radius_d = u_radius / current_depth;
 
-    for (int i = 0; i < u_sample_count; ++i) {
+    for (int i = 0; i < SAMPLE_COUNT; ++i) {
         vec3 ray = radius_d * reflect(poisson_sphere[i], random_normal);
 
         vec3 se = ep + sign(dot(ray, current_normal)) * ray;
 
-        vec4 occluder_sample = texture(u_normal_depth_map, se.xy);
+        float offset_texels = length((se.xy - ep.xy) * vec2(size));
+        int level = clamp(int(log2(max(offset_texels, 1.0))) - LOG_MAX_OFFSET, 0, max_level);
+
+        vec4 occluder_sample = decode_normal_depth(texelFetch(u_normal_depth_map,
+            clamp(ivec2(se.xy * vec2(size)) >> level, ivec2(0), max(size >> level, ivec2(1)) - 1), level));
 
         float depth_diff = current_depth - occluder_sample.a;
         if (depth_diff > u_depth_bias) continue;
@@ -68,6 +66,6 @@ void main() {
         bl += step(u_falloff, depth_diff) * norm_diff * (1.0 - smoothstep(u_falloff, u_strength, depth_diff));
     }
 
-    float ao = 1.0 - u_total_strength * bl / float(u_sample_count);
+    float ao = 1.0 - u_total_strength * bl / float(SAMPLE_COUNT);
     occlusion = ao;
 }
@@ -0,0 +1,20 @@
+#version 330 core
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+flat in int v_layer[];
+
+void main() {
+    for (int i = 0; i < 3; ++i) {
+        gl_Layer = v_layer[i];
+        gl_Position = gl_in[i].gl_Position;
+        gl_ClipDistance[0] = gl_in[i].gl_ClipDistance[0];
+        gl_ClipDistance[1] = gl_in[i].gl_ClipDistance[1];
+        gl_ClipDistance[2] = gl_in[i].gl_ClipDistance[2];
+        gl_ClipDistance[3] = gl_in[i].gl_ClipDistance[3];
+        EmitVertex();
+    }
+
+    EndPrimitive();
+}
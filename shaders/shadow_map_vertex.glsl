@@ -1,9 +1,31 @@
 #version 330 core
 
 layout(location = 0) in vec3 position_objectspace;
+layout(location = 5) in mat4 instance_model;
 
-uniform mat4 depth_mvp_matrix;
+flat out int v_layer;
+
+#include "common/world_matrices.glsl"
+
+uniform mat4 u_depth_mvp_matrices[MAX_SHADOW_VIEWS];
+uniform vec4 u_view_rects[MAX_SHADOW_VIEWS];
+uniform int u_view_pages[MAX_SHADOW_VIEWS];
+uniform int u_views[MAX_SHADOW_VIEWS];
+uniform int u_view_count;
+uniform bool u_instanced;
 
 void main() {
-    gl_Position = depth_mvp_matrix * vec4(position_objectspace, 1);
+    mat4 model = u_instanced ? instance_model : world_matrix(u_node);
+    int view = u_views[gl_InstanceID % u_view_count];
+
+    vec4 position = u_depth_mvp_matrices[view] * model * vec4(position_objectspace, 1);
+
+    gl_ClipDistance[0] = position.w + position.x;
+    gl_ClipDistance[1] = position.w - position.x;
+    gl_ClipDistance[2] = position.w + position.y;
+    gl_ClipDistance[3] = position.w - position.y;
+
+    vec4 rect = u_view_rects[view];
+    gl_Position = vec4(position.xy * rect.zw + (2 * rect.xy + rect.zw - 1) * position.w, position.zw);
+    v_layer = u_view_pages[view];
 }
@@ -0,0 +1,32 @@
+#version 330 core
+
+precision mediump float;
+
+in vec2 v_tex_coord;
+
+layout(location = 0) out vec4 frag_color;
+
+#include "common/transformations.glsl"
+#include "common/light_params.glsl"
+#include "common/normal_depth.glsl"
+#include "common/shadows.glsl"
+
+uniform sampler2D u_normal_depth_map;
+uniform float u_far = 100.0;
+
+// one light per channel at the surfaces of the prepass, lighting upsamples it
+void main() {
+    frag_color = vec4(1.0);
+
+    vec4 normal_depth = fetch_normal_depth(u_normal_depth_map, v_tex_coord);
+    if (normal_depth.a <= 0.0) return;
+
+    float eye_depth = normal_depth.a * u_far;
+    vec3 pos_eyespace = vec3((v_tex_coord * 2.0 - 1.0) * eye_depth /
+        vec2(projection_matrix[0][0], projection_matrix[1][1]), -eye_depth);
+
+    // the view matrix is rigid, so its inverse is the transposed rotation
+    vec3 pos_worldspace = transpose(mat3(mv_matrix)) * (pos_eyespace - mv_matrix[3].xyz);
+
+    for (int i = 0; i < min(num_lights, SHADOW_MASK_LIGHTS); ++i) frag_color[i] = shadow_visibility(i, pos_worldspace);
+}
@@ -0,0 +1,40 @@
+#version 330 core
+
+layout(location = 0) out vec4 moments;
+
+#include "common/evsm.glsl"
+
+const int MAX_BLUR_RADIUS = 8;
+
+uniform sampler2DArray u_depth_maps;
+uniform sampler2D u_moments;
+uniform bool u_from_depth;
+uniform int u_page;
+uniform ivec4 u_tile;
+uniform ivec2 u_direction;
+uniform int u_blur_radius = 2;
+
+vec4 fetch(in ivec2 texel) {
+    texel = clamp(texel, u_tile.xy, u_tile.zw);
+
+    return u_from_depth
+        ? warp_depth(texelFetch(u_depth_maps, ivec3(texel, u_page), 0).r)
+        : texelFetch(u_moments, texel, 0);
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float sigma = 0.5 * u_blur_radius + 0.5;
+
+    vec4 sum = vec4(0);
+    float total_weight = 0;
+    for (int i = -MAX_BLUR_RADIUS; i <= MAX_BLUR_RADIUS; ++i) {
+        if (abs(i) > u_blur_radius) continue;
+
+        float weight = exp(-float(i * i) / (2 * sigma * sigma));
+        sum += weight * fetch(texel + i * u_direction);
+        total_weight += weight;
+    }
+
+    moments = sum / total_weight;
+}
@@ -2,7 +2,10 @@
 
 precision mediump float;
 
-in vec3 v_tex_coord;
+in vertex_data {
+    vec3 v_tex_coord;
+    flat int v_face;
+};
 
 uniform samplerCube u_map;
 
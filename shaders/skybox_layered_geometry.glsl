@@ -0,0 +1,26 @@
+#version 330 core
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+in vertex_data {
+    vec3 v_tex_coord;
+    flat int v_face;
+} vertex_in[];
+
+out vertex_data {
+    vec3 v_tex_coord;
+    flat int v_face;
+} vertex_out;
+
+void main() {
+    for (int i = 0; i < 3; ++i) {
+        gl_Layer = vertex_in[i].v_face;
+        gl_Position = gl_in[i].gl_Position;
+        vertex_out.v_tex_coord = vertex_in[i].v_tex_coord;
+        vertex_out.v_face = vertex_in[i].v_face;
+        EmitVertex();
+    }
+
+    EndPrimitive();
+}
@@ -2,17 +2,19 @@
 
 layout(location = 0) in vec3 position;
 
-out vec3 v_tex_coord;
-
-layout(std140) uniform transformations {
-    mat4 depth_bias_matrix;
-    mat4 mv_matrix;
-    mat4 mvp_matrix;
-    mat4 projection_matrix;
-    mat3 normal_matrix;
+out vertex_data {
+    vec3 v_tex_coord;
+    flat int v_face;
 };
 
+#include "common/transformations.glsl"
+#include "common/cube_transformations.glsl"
+
+uniform bool u_layered;
+uniform int u_faces[6];
+
 void main() {
-    gl_Position = mvp_matrix * vec4(50 * position, 1);
+    v_face = u_layered ? u_faces[gl_InstanceID] : 0;
+    gl_Position = ((u_layered ? cube_mvp_matrices[v_face] : mvp_matrix) * vec4(50 * position, 1)).xyww;
     v_tex_coord = position;
 }
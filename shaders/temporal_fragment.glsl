@@ -0,0 +1,47 @@
+#version 330 core
+
+precision mediump float;
+
+in vec2 v_tex_coord;
+
+layout(location = 0) out vec4 result;
+
+uniform sampler2D u_current;
+uniform sampler2D u_history;
+uniform sampler2D u_normal_depth_map;
+uniform sampler2D u_prev_normal_depth_map;
+
+uniform mat4 u_reprojection_matrix;
+uniform mat3 u_normal_reprojection_matrix;
+uniform vec2 u_projection_scale;
+uniform float u_far = 100.0;
+uniform float u_alpha = 0.1;
+uniform float u_depth_threshold = 0.05;
+uniform float u_normal_threshold = 0.9;
+uniform bool u_history_valid = false;
+
+#include "common/normal_depth.glsl"
+
+void main() {
+    vec4 current = texture(u_current, v_tex_coord);
+    vec4 normal_depth = fetch_normal_depth(u_normal_depth_map, v_tex_coord);
+
+    result = current;
+    if (!u_history_valid || normal_depth.a <= 0.0) return;
+
+    float eye_depth = normal_depth.a * u_far;
+    vec3 pos_eyespace = vec3((v_tex_coord * 2.0 - 1.0) * eye_depth / u_projection_scale, -eye_depth);
+
+    vec4 prev_clip = u_reprojection_matrix * vec4(pos_eyespace, 1.0);
+    vec2 prev_tex_coord = prev_clip.xy / prev_clip.w * 0.5 + 0.5;
+    if (any(lessThan(prev_tex_coord, vec2(0.0))) || any(greaterThan(prev_tex_coord, vec2(1.0)))) return;
+
+    vec4 prev_normal_depth = fetch_normal_depth(u_prev_normal_depth_map, prev_tex_coord);
+    float expected_depth = prev_clip.w / u_far;
+    if (abs(prev_normal_depth.a - expected_depth) > u_depth_threshold * expected_depth) return;
+
+    vec3 normal_prev_eyespace = normalize(u_normal_reprojection_matrix * normal_depth.rgb);
+    if (dot(prev_normal_depth.rgb, normal_prev_eyespace) < u_normal_threshold) return;
+
+    result = mix(texture(u_history, prev_tex_coord), current, u_alpha);
+}
@@ -0,0 +1,258 @@
+#include "batch_math.h"
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BATCH_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BATCH_NEON 1
+#endif
+
+namespace batch {
+
+namespace {
+
+#if defined(BATCH_SSE)
+
+using float4 = __m128;
+
+inline float4 load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, const float4 v) { _mm_storeu_ps(p, v); }
+inline float4 splat(const float f) { return _mm_set1_ps(f); }
+inline float4 add(const float4 a, const float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub(const float4 a, const float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul(const float4 a, const float4 b) { return _mm_mul_ps(a, b); }
+inline float4 div(const float4 a, const float4 b) { return _mm_div_ps(a, b); }
+inline int greater_equal(const float4 a, const float4 b) { return _mm_movemask_ps(_mm_cmpge_ps(a, b)); }
+inline void transpose(float4& r0, float4& r1, float4& r2, float4& r3) { _MM_TRANSPOSE4_PS(r0, r1, r2, r3); }
+
+#elif defined(BATCH_NEON)
+
+using float4 = float32x4_t;
+
+inline float4 load(const float* p) { return vld1q_f32(p); }
+inline void store(float* p, const float4 v) { vst1q_f32(p, v); }
+inline float4 splat(const float f) { return vdupq_n_f32(f); }
+inline float4 add(const float4 a, const float4 b) { return vaddq_f32(a, b); }
+inline float4 sub(const float4 a, const float4 b) { return vsubq_f32(a, b); }
+inline float4 mul(const float4 a, const float4 b) { return vmulq_f32(a, b); }
+
+inline float4 div(const float4 a, const float4 b) {
+    auto reciprocal = vrecpeq_f32(b);
+    reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+    reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+    return vmulq_f32(a, reciprocal);
+}
+
+inline int greater_equal(const float4 a, const float4 b) {
+    const uint32_t bits[] { 1, 2, 4, 8 };
+    return static_cast<int>(vaddvq_u32(vandq_u32(vcgeq_f32(a, b), vld1q_u32(bits))));
+}
+
+inline void transpose(float4& r0, float4& r1, float4& r2, float4& r3) {
+    const auto t0 = vreinterpretq_f64_f32(vtrn1q_f32(r0, r1)), t1 = vreinterpretq_f64_f32(vtrn2q_f32(r0, r1));
+    const auto t2 = vreinterpretq_f64_f32(vtrn1q_f32(r2, r3)), t3 = vreinterpretq_f64_f32(vtrn2q_f32(r2, r3));
+    r0 = vreinterpretq_f32_f64(vtrn1q_f64(t0, t2));
+    r1 = vreinterpretq_f32_f64(vtrn1q_f64(t1, t3));
+    r2 = vreinterpretq_f32_f64(vtrn2q_f64(t0, t2));
+    r3 = vreinterpretq_f32_f64(vtrn2q_f64(t1, t3));
+}
+
+#endif
+
+#if defined(BATCH_SSE) || defined(BATCH_NEON)
+#define BATCH_SIMD 1
+
+/* rows receive x, y, z, w of column of m[0..3], one matrix per lane */
+inline void load_column(const glm::mat4* m, const int column, float4 (&rows)[4]) {
+    for (auto lane = 0; lane < 4; ++lane) rows[lane] = load(&m[lane][column][0]);
+    transpose(rows[0], rows[1], rows[2], rows[3]);
+}
+
+inline void store_column(glm::mat4* m, const int column, float4 (&rows)[4]) {
+    transpose(rows[0], rows[1], rows[2], rows[3]);
+    for (auto lane = 0; lane < 4; ++lane) store(&m[lane][column][0], rows[lane]);
+}
+
+/* out = a * b with the columns of a already loaded, b is read column by column before out is written */
+inline void multiply_columns(const float4 (&a)[4], const glm::mat4& b, glm::mat4& out) {
+    for (auto column = 0; column < 4; ++column) {
+        const auto& c = b[column];
+        const auto result = add(add(mul(a[0], splat(c[0])), mul(a[1], splat(c[1]))),
+            add(mul(a[2], splat(c[2])), mul(a[3], splat(c[3]))));
+        store(&out[column][0], result);
+    }
+}
+#else
+void multiply_scalar(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+    const auto left = a;
+    for (auto column = 0; column < 4; ++column) {
+        const auto c = b[column];
+        for (auto row = 0; row < 4; ++row) {
+            out[column][row] = left[0][row] * c[0] + left[1][row] * c[1] + left[2][row] * c[2] + left[3][row] * c[3];
+        }
+    }
+}
+#endif
+
+void normal_matrix_scalar(const glm::mat4& m, glm::mat4& out) {
+    const auto a = m[0][0], b = m[0][1], c = m[0][2];
+    const auto d = m[1][0], e = m[1][1], f = m[1][2];
+    const auto g = m[2][0], h = m[2][1], i = m[2][2];
+
+    /* the columns of the inverse transpose are the cross products of the other two columns over the determinant */
+    const auto c00 = e * i - f * h, c01 = f * g - d * i, c02 = d * h - e * g;
+    const auto inv_det = 1 / (a * c00 + b * c01 + c * c02);
+
+    out = glm::mat4();
+    out[0][0] = c00 * inv_det;
+    out[0][1] = c01 * inv_det;
+    out[0][2] = c02 * inv_det;
+    out[1][0] = (h * c - i * b) * inv_det;
+    out[1][1] = (i * a - g * c) * inv_det;
+    out[1][2] = (g * b - h * a) * inv_det;
+    out[2][0] = (b * f - c * e) * inv_det;
+    out[2][1] = (c * d - a * f) * inv_det;
+    out[2][2] = (a * e - b * d) * inv_det;
+}
+
+/* a box behind a plane stays behind it by dot(abs(normal), extent) */
+float box_radius(const glm::vec4& plane, const float extent_x, const float extent_y, const float extent_z) {
+    return std::abs(plane.x) * extent_x + std::abs(plane.y) * extent_y + std::abs(plane.z) * extent_z;
+}
+
+} /* namespace */
+
+void multiply(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, const size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+#ifdef BATCH_SIMD
+        const float4 columns[] { load(&a[i][0][0]), load(&a[i][1][0]), load(&a[i][2][0]), load(&a[i][3][0]) };
+        multiply_columns(columns, b[i], out[i]);
+#else
+        multiply_scalar(a[i], b[i], out[i]);
+#endif
+    }
+}
+
+void multiply(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, const size_t count) {
+#ifdef BATCH_SIMD
+    const float4 columns[] { load(&a[0][0]), load(&a[1][0]), load(&a[2][0]), load(&a[3][0]) };
+    for (size_t i = 0; i < count; ++i) multiply_columns(columns, b[i], out[i]);
+#else
+    for (size_t i = 0; i < count; ++i) multiply_scalar(a, b[i], out[i]);
+#endif
+}
+
+void normal_matrices(const glm::mat4* m, glm::mat4* out, const size_t count) {
+    auto i = size_t{};
+
+#ifdef BATCH_SIMD
+    /* four matrices per iteration, one per lane */
+    for (; i + 4 <= count; i += 4) {
+        float4 c0[4], c1[4], c2[4];
+        load_column(m + i, 0, c0);
+        load_column(m + i, 1, c1);
+        load_column(m + i, 2, c2);
+
+        const auto a = c0[0], b = c0[1], c = c0[2];
+        const auto d = c1[0], e = c1[1], f = c1[2];
+        const auto g = c2[0], h = c2[1], k = c2[2];
+
+        const auto c00 = sub(mul(e, k), mul(f, h));
+        const auto c01 = sub(mul(f, g), mul(d, k));
+        const auto c02 = sub(mul(d, h), mul(e, g));
+        const auto inv_det = div(splat(1), add(add(mul(a, c00), mul(b, c01)), mul(c, c02)));
+        const auto zero = splat(0);
+
+        float4 columns[3][4] {
+            { mul(c00, inv_det), mul(c01, inv_det), mul(c02, inv_det), zero },
+            { mul(sub(mul(h, c), mul(k, b)), inv_det), mul(sub(mul(k, a), mul(g, c)), inv_det),
+                mul(sub(mul(g, b), mul(h, a)), inv_det), zero },
+            { mul(sub(mul(b, f), mul(c, e)), inv_det), mul(sub(mul(c, d), mul(a, f)), inv_det),
+                mul(sub(mul(a, e), mul(b, d)), inv_det), zero },
+        };
+
+        for (auto column = 0; column < 3; ++column) store_column(out + i, column, columns[column]);
+        for (auto lane = 0; lane < 4; ++lane) out[i + lane][3] = glm::vec4(0, 0, 0, 1);
+    }
+#endif
+
+    for (; i < count; ++i) normal_matrix_scalar(m[i], out[i]);
+}
+
+frustum extract_frustum(const glm::mat4& mvp) {
+    const auto row = [&mvp] (const int r) { return glm::vec4(mvp[0][r], mvp[1][r], mvp[2][r], mvp[3][r]); };
+
+    auto f = frustum{ {
+        row(3) + row(0), row(3) - row(0),
+        row(3) + row(1), row(3) - row(1),
+        row(3) + row(2), row(3) - row(2),
+    } };
+
+    for (auto& plane : f.planes) plane /= glm::length(glm::vec3(plane));
+    return f;
+}
+
+void cull_spheres(const frustum& f, const float* x, const float* y, const float* z, const float* radius,
+    const size_t count, uint8_t* visible) {
+
+    auto i = size_t{};
+
+#ifdef BATCH_SIMD
+    for (; i + 4 <= count; i += 4) {
+        const auto px = load(x + i), py = load(y + i), pz = load(z + i);
+        const auto negative_radius = sub(splat(0), load(radius + i));
+
+        auto inside = 0xf;
+        for (const auto& plane : f.planes) {
+            const auto distance = add(add(mul(px, splat(plane.x)), mul(py, splat(plane.y))),
+                add(mul(pz, splat(plane.z)), splat(plane.w)));
+            inside &= greater_equal(distance, negative_radius);
+        }
+
+        for (auto lane = 0; lane < 4; ++lane) visible[i + lane] = (inside >> lane) & 1;
+    }
+#endif
+
+    for (; i < count; ++i) {
+        visible[i] = 1;
+        for (const auto& plane : f.planes) {
+            if (plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w < -radius[i]) visible[i] = 0;
+        }
+    }
+}
+
+void cull_aabbs(const frustum& f, const float* center_x, const float* center_y, const float* center_z,
+    const float* extent_x, const float* extent_y, const float* extent_z, const size_t count, uint8_t* visible) {
+
+    auto i = size_t{};
+
+#ifdef BATCH_SIMD
+    for (; i + 4 <= count; i += 4) {
+        const auto cx = load(center_x + i), cy = load(center_y + i), cz = load(center_z + i);
+        const auto ex = load(extent_x + i), ey = load(extent_y + i), ez = load(extent_z + i);
+
+        auto inside = 0xf;
+        for (const auto& plane : f.planes) {
+            const auto distance = add(add(mul(cx, splat(plane.x)), mul(cy, splat(plane.y))),
+                add(mul(cz, splat(plane.z)), splat(plane.w)));
+            const auto radius = add(add(mul(ex, splat(std::abs(plane.x))), mul(ey, splat(std::abs(plane.y)))),
+                mul(ez, splat(std::abs(plane.z))));
+            inside &= greater_equal(distance, sub(splat(0), radius));
+        }
+
+        for (auto lane = 0; lane < 4; ++lane) visible[i + lane] = (inside >> lane) & 1;
+    }
+#endif
+
+    for (; i < count; ++i) {
+        visible[i] = 1;
+        for (const auto& plane : f.planes) {
+            const auto distance = plane.x * center_x[i] + plane.y * center_y[i] + plane.z * center_z[i] + plane.w;
+            if (distance < -box_radius(plane, extent_x[i], extent_y[i], extent_z[i])) visible[i] = 0;
+        }
+    }
+}
+
+} /* namespace batch */
@@ -0,0 +1,39 @@
+#ifndef batch_math_h
+#define batch_math_h
+
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <cstddef>
+#include <cstdint>
+
+/* Matrix and culling math over arrays, four lanes at a time with SSE or NEON and scalar otherwise. */
+namespace batch {
+
+/* out[i] = a[i] * b[i], out may alias a or b. */
+void multiply(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t count);
+
+/* out[i] = a * b[i], out may alias b. */
+void multiply(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, size_t count);
+
+/* The upper 3x3 of out[i] is transpose(inverse(mat3(m[i]))), the rest is identity. out may alias m. */
+void normal_matrices(const glm::mat4* m, glm::mat4* out, size_t count);
+
+/* dot(plane, vec4(p, 1)) >= 0 inside, normals are unit length and point inwards */
+struct frustum {
+    glm::vec4 planes[6];
+};
+
+/* Planes of the clip volume of mvp in the space mvp transforms from. */
+frustum extract_frustum(const glm::mat4& mvp);
+
+/* visible[i] is 1 unless the sphere lies entirely behind one of the planes. */
+void cull_spheres(const frustum& f, const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint8_t* visible);
+
+/* visible[i] is 1 unless the box (center, half extent) lies entirely behind one of the planes. */
+void cull_aabbs(const frustum& f, const float* center_x, const float* center_y, const float* center_z,
+    const float* extent_x, const float* extent_y, const float* extent_z, size_t count, uint8_t* visible);
+
+} /* namespace batch */
+
+#endif /* batch_math_h */
@@ -0,0 +1,177 @@
+#include "clusters.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CLUSTERS_SSE 1
+#endif
+
+namespace clusters {
+
+namespace {
+
+struct candidates {
+    std::vector<float> x, y, z, radius_sq;
+    std::vector<GLushort> index;
+
+    void clear() {
+        x.clear();
+        y.clear();
+        z.clear();
+        radius_sq.clear();
+        index.clear();
+    }
+
+    void push_back(const glm::vec4& pos_radius, const GLushort i) {
+        x.push_back(pos_radius.x);
+        y.push_back(pos_radius.y);
+        z.push_back(pos_radius.z);
+        radius_sq.push_back(pos_radius.w * pos_radius.w);
+        index.push_back(i);
+    }
+
+    void pad() {
+        while (x.size() % 4 != 0) {
+            push_back({ 0, 0, 0, 0 }, 0);
+            radius_sq.back() = -1;
+        }
+    }
+};
+
+struct aabb {
+    float min_x, min_y, min_z;
+    float max_x, max_y, max_z;
+};
+
+void append_overlapping(const candidates& c, const aabb& box, std::vector<GLushort>& out) {
+#ifdef CLUSTERS_SSE
+    const auto zero = _mm_setzero_ps();
+    const auto min_x = _mm_set1_ps(box.min_x), max_x = _mm_set1_ps(box.max_x);
+    const auto min_y = _mm_set1_ps(box.min_y), max_y = _mm_set1_ps(box.max_y);
+    const auto min_z = _mm_set1_ps(box.min_z), max_z = _mm_set1_ps(box.max_z);
+
+    for (size_t i = 0; i < c.x.size(); i += 4) {
+        const auto x = _mm_loadu_ps(&c.x[i]);
+        const auto y = _mm_loadu_ps(&c.y[i]);
+        const auto z = _mm_loadu_ps(&c.z[i]);
+        const auto dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_x, x), _mm_sub_ps(x, max_x)), zero);
+        const auto dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_y, y), _mm_sub_ps(y, max_y)), zero);
+        const auto dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_z, z), _mm_sub_ps(z, max_z)), zero);
+        const auto distance_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        const auto mask = _mm_movemask_ps(_mm_cmple_ps(distance_sq, _mm_loadu_ps(&c.radius_sq[i])));
+        if (mask == 0) continue;
+
+        for (auto lane = 0; lane < 4; ++lane) {
+            if (mask & (1 << lane)) out.push_back(c.index[i + lane]);
+        }
+    }
+#else
+    for (size_t i = 0; i < c.x.size(); ++i) {
+        const auto dx = std::max(std::max(box.min_x - c.x[i], c.x[i] - box.max_x), 0.0f);
+        const auto dy = std::max(std::max(box.min_y - c.y[i], c.y[i] - box.max_y), 0.0f);
+        const auto dz = std::max(std::max(box.min_z - c.z[i], c.z[i] - box.max_z), 0.0f);
+        if (dx * dx + dy * dy + dz * dz <= c.radius_sq[i]) out.push_back(c.index[i]);
+    }
+#endif
+}
+
+float slice_depth(const int slice, const float near, const float far) {
+    return near * std::pow(far / near, static_cast<float>(slice) / GRID_Z);
+}
+
+void assign_slices(const std::vector<point_light>& lights, const glm::mat4& projection, const float near,
+    const float far, const int first_slice, const int last_slice, grid& out) {
+
+    auto c = candidates{};
+    auto row = candidates{};
+    auto row_lights = std::vector<GLushort>{};
+
+    for (auto slice = first_slice; slice < last_slice; ++slice) {
+        const auto near_depth = slice_depth(slice, near, far);
+        const auto far_depth = slice_depth(slice + 1, near, far);
+
+        c.clear();
+        for (size_t i = 0; i < lights.size(); ++i) {
+            const auto& l = lights[i].pos_radius;
+            if (l.z - l.w <= -near_depth && l.z + l.w >= -far_depth) c.push_back(l, static_cast<GLushort>(i));
+        }
+        c.pad();
+
+        const auto left = -far_depth / projection[0][0];
+        const auto right = far_depth / projection[0][0];
+
+        for (auto y = 0; y < GRID_Y; ++y) {
+            const auto y0 = (-1 + 2.0f * y / GRID_Y) / projection[1][1];
+            const auto y1 = (-1 + 2.0f * (y + 1) / GRID_Y) / projection[1][1];
+
+            const auto row_box = aabb{
+                left, std::min(y0 * near_depth, y0 * far_depth), -far_depth,
+                right, std::max(y1 * near_depth, y1 * far_depth), -near_depth
+            };
+
+            row_lights.clear();
+            append_overlapping(c, row_box, row_lights);
+
+            row.clear();
+            for (const auto i : row_lights) row.push_back(lights[i].pos_radius, i);
+            row.pad();
+
+            for (auto x = 0; x < GRID_X; ++x) {
+                const auto x0 = (-1 + 2.0f * x / GRID_X) / projection[0][0];
+                const auto x1 = (-1 + 2.0f * (x + 1) / GRID_X) / projection[0][0];
+
+                const auto box = aabb{
+                    std::min(x0 * near_depth, x0 * far_depth), std::min(y0 * near_depth, y0 * far_depth), -far_depth,
+                    std::max(x1 * near_depth, x1 * far_depth), std::max(y1 * near_depth, y1 * far_depth), -near_depth
+                };
+
+                const auto cluster = (slice * GRID_Y + y) * GRID_X + x;
+                out.ranges[2 * cluster] = static_cast<GLuint>(out.indices.size());
+                append_overlapping(row, box, out.indices);
+                out.ranges[2 * cluster + 1] = static_cast<GLuint>(out.indices.size()) - out.ranges[2 * cluster];
+            }
+        }
+    }
+}
+
+} /* namespace */
+
+void assign(const std::vector<point_light>& lights, const glm::mat4& projection, const float near, const float far,
+    job_system& jobs, grid& out) {
+
+    out.ranges.assign(2 * CLUSTER_COUNT, 0);
+    out.indices.clear();
+
+    const auto workers = std::max(1, std::min(static_cast<int>(jobs.thread_count()), GRID_Z));
+    auto partial = std::vector<grid>(workers);
+
+    jobs.parallel_for(0, workers, 1, [&] (const size_t first, const size_t last) {
+        for (auto i = static_cast<int>(first); i < static_cast<int>(last); ++i) {
+            partial[i].ranges.assign(2 * CLUSTER_COUNT, 0);
+            const auto first_slice = i * GRID_Z / workers;
+            const auto last_slice = (i + 1) * GRID_Z / workers;
+            assign_slices(lights, projection, near, far, first_slice, last_slice, partial[i]);
+        }
+    });
+
+    for (auto i = 0; i < workers; ++i) {
+        const auto base = static_cast<GLuint>(out.indices.size());
+        const auto available = static_cast<size_t>(MAX_INDICES) - base;
+        const auto count = std::min(partial[i].indices.size(), available);
+        out.indices.insert(out.indices.end(), partial[i].indices.begin(), partial[i].indices.begin() + count);
+
+        for (auto slice = i * GRID_Z / workers; slice < (i + 1) * GRID_Z / workers; ++slice) {
+            for (auto cluster = slice * GRID_Y * GRID_X; cluster < (slice + 1) * GRID_Y * GRID_X; ++cluster) {
+                const auto offset = partial[i].ranges[2 * cluster];
+                out.ranges[2 * cluster] = base + offset;
+                out.ranges[2 * cluster + 1] = offset < count
+                    ? std::min(partial[i].ranges[2 * cluster + 1], static_cast<GLuint>(count) - offset)
+                    : 0;
+            }
+        }
+    }
+}
+
+} /* namespace clusters */
@@ -0,0 +1,36 @@
+#ifndef clusters_h
+#define clusters_h
+
+#include "gl/gl_include.h"
+#include "job_system.h"
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <vector>
+
+namespace clusters {
+
+const auto GRID_X = 16;
+const auto GRID_Y = 9;
+const auto GRID_Z = 24;
+const auto CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+const auto MAX_POINT_LIGHTS = 4096;
+const auto MAX_INDICES = 512 * 1024;
+
+struct point_light {
+    glm::vec4 pos_radius;
+    glm::vec4 color;
+};
+
+struct grid {
+    std::vector<GLuint> ranges;
+    std::vector<GLushort> indices;
+};
+
+/* Lights are in eye space. ranges receives an (offset, count) pair per cluster,
+ * clusters are laid out x fastest with slices spaced exponentially between near and far. */
+void assign(const std::vector<point_light>& lights, const glm::mat4& projection, float near, float far,
+    job_system& jobs, grid& out);
+
+} /* namespace clusters */
+
+#endif /* clusters_h */
@@ -7,16 +7,8 @@ debug_surface::~debug_surface() {
     glDeleteProgram(program_id);
 }
 
-void debug_surface::init() {
-    const std::pair<const char*, GLenum> shaders[] {
-        { "shaders/debug_vertex.glsl", GL_VERTEX_SHADER },
-        { "shaders/debug_fragment.glsl", GL_FRAGMENT_SHADER },
-    };
-
-    const auto program_id = gl::load_shader_program(shaders);
-    gl::link_shader_program(program_id);
-
-    this->program_id = program_id;
+void debug_surface::init(gl::program_batch& programs) {
+    add_program(programs);
 
     const GLfloat vertices[] {
         -1, 1,
@@ -37,6 +29,15 @@ void debug_surface::init() {
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(vertices[0]), 0);
 }
 
+void debug_surface::add_program(gl::program_batch& programs) {
+    const std::pair<const char*, GLenum> shaders[] {
+        { "shaders/debug_vertex.glsl", GL_VERTEX_SHADER },
+        { "shaders/debug_fragment.glsl", GL_FRAGMENT_SHADER },
+    };
+
+    programs.add(shaders, [this] (const GLuint program_id) { this->program_id = program_id; }, std::string{}, program_id);
+}
+
 void debug_surface::draw(const GLuint tex_id, const glm::vec4 rect) const {
     glViewport(rect.x, rect.y, rect.z, rect.w);
 
@@ -1,7 +1,7 @@
 #ifndef debug_surface_h
 #define debug_surface_h
 
-#include "gl/gl_include.h"
+#include "gl/util.h"
 #include <glm/vec4.hpp>
 
 class debug_surface {
@@ -16,7 +16,8 @@ public:
     debug_surface() = default;
     ~debug_surface();
 
-    void init();
+    void init(gl::program_batch& programs);
+    void add_program(gl::program_batch& programs);
 
     void draw(GLuint tex_id, glm::vec4 rect) const;
 };
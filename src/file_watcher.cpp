@@ -0,0 +1,94 @@
+#include "file_watcher.h"
+#include <chrono>
+#include <map>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+file_watcher::file_watcher(const std::vector<std::string>& dirs) : dirs(dirs), stopping(false) {
+    thread = std::thread{[this] { watch(); }};
+}
+
+file_watcher::~file_watcher() {
+    stopping = true;
+    thread.join();
+}
+
+std::set<std::string> file_watcher::changed_files() {
+    std::lock_guard<std::mutex> lock{changed_mutex};
+
+    auto files = std::set<std::string>{};
+    files.swap(changed);
+    return files;
+}
+
+void file_watcher::mark_changed(const std::string& path) {
+    std::lock_guard<std::mutex> lock{changed_mutex};
+    changed.insert(path);
+}
+
+#ifdef __linux__
+
+void file_watcher::watch() {
+    const auto fd = inotify_init1(IN_NONBLOCK);
+    if (fd < 0) return;
+
+    auto watched_dirs = std::map<int, std::string>{};
+    for (const auto& dir : dirs) {
+        /* editors either write in place or rename a temporary over the file */
+        const auto wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd >= 0) watched_dirs[wd] = dir;
+    }
+
+    alignas(inotify_event) char buffer[4096];
+    while (!stopping) {
+        auto poll_fd = pollfd{ fd, POLLIN, 0 };
+        if (poll(&poll_fd, 1, 100) <= 0) continue;
+
+        const auto length = read(fd, buffer, sizeof(buffer));
+        for (auto offset = ssize_t{}; offset < length; ) {
+            const auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            if (event->len > 0) mark_changed(watched_dirs[event->wd] + '/' + event->name);
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    close(fd);
+}
+
+#else
+
+void file_watcher::watch() {
+    auto modified = std::map<std::string, long long>{};
+    auto first_scan = true;
+
+    while (!stopping) {
+        for (const auto& dir : dirs) {
+            const auto dir_handle = opendir(dir.c_str());
+            if (!dir_handle) continue;
+
+            while (const auto dir_entry = readdir(dir_handle)) {
+                const auto path = dir + '/' + dir_entry->d_name;
+
+                struct stat file_stat;
+                if (stat(path.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) continue;
+
+                auto& last_modified = modified[path];
+                if (!first_scan && last_modified != file_stat.st_mtime) mark_changed(path);
+                last_modified = file_stat.st_mtime;
+            }
+            closedir(dir_handle);
+        }
+
+        first_scan = false;
+        std::this_thread::sleep_for(std::chrono::milliseconds{250});
+    }
+}
+
+#endif
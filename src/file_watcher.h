@@ -0,0 +1,34 @@
+#ifndef file_watcher_h
+#define file_watcher_h
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Watches the files of some directories (not recursively) on a background thread, using inotify on Linux
+ * and polling modification times elsewhere. */
+class file_watcher {
+    file_watcher(const file_watcher&) = delete;
+    file_watcher& operator=(const file_watcher&) = delete;
+
+    std::vector<std::string> dirs;
+    std::thread thread;
+    std::atomic<bool> stopping;
+    std::mutex changed_mutex;
+    std::set<std::string> changed;
+
+    void watch();
+    void mark_changed(const std::string& path);
+
+public:
+    explicit file_watcher(const std::vector<std::string>& dirs);
+    ~file_watcher();
+
+    /* Paths (dir/name) written since the last call. */
+    std::set<std::string> changed_files();
+};
+
+#endif /* file_watcher_h */
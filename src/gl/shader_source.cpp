@@ -0,0 +1,233 @@
+#include "shader_source.h"
+#include "util.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+namespace gl {
+
+namespace {
+
+std::mutex sources_mutex;
+std::map<std::string, shader_source> sources;
+std::string constants;
+
+struct expansion {
+    shader_source source;
+    std::string prologue;
+    std::set<std::string> included;
+    std::map<std::string, int> int_macros;
+};
+
+bool is_number(const std::string& token) {
+    return !token.empty() && std::all_of(std::begin(token), std::end(token),
+        [] (const char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; });
+}
+
+bool starts_with(const std::string& line, const char* prefix) {
+    const auto first = line.find_first_not_of(" \t");
+    return first != std::string::npos && line.compare(first, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+std::string directory_of(const std::string& file_name) {
+    const auto slash = file_name.rfind('/');
+    return slash == std::string::npos ? std::string{} : file_name.substr(0, slash + 1);
+}
+
+/* first definition wins, which matches the "#ifndef NAME #define NAME default" pattern of the shaders */
+void track_defines(const std::string& text, expansion& e) {
+    auto lines = std::istringstream{text};
+    auto line = std::string{};
+    while (std::getline(lines, line)) {
+        if (!starts_with(line, "#define")) continue;
+
+        auto tokens = std::istringstream{line};
+        auto directive = std::string{}, name = std::string{}, value = std::string{};
+        tokens >> directive >> name >> value;
+        if (is_number(value) && e.int_macros.count(name) == 0) e.int_macros[name] = std::stoi(value);
+    }
+}
+
+/* Mitchell's best candidate, deterministic so the generated source and the binary cache key stay stable */
+std::vector<std::array<float, 3>> best_candidates(const int count, const int dimensions) {
+    auto rng = std::mt19937{0x5eed};
+    const auto uniform = [&rng] { return static_cast<float>(rng() / 4294967296.0) * 2 - 1; };
+
+    auto points = std::vector<std::array<float, 3>>{};
+    for (auto i = 0; i < count; ++i) {
+        auto best = std::array<float, 3>{};
+        auto best_distance = -1.0f;
+
+        for (auto candidate = 0; candidate < 8 * (i + 1); ++candidate) {
+            auto point = std::array<float, 3>{};
+            do {
+                for (auto d = 0; d < dimensions; ++d) point[d] = uniform();
+            } while (point[0] * point[0] + point[1] * point[1] + point[2] * point[2] > 1);
+
+            auto nearest = std::numeric_limits<float>::max();
+            for (const auto& other : points) {
+                const auto dx = point[0] - other[0], dy = point[1] - other[1], dz = point[2] - other[2];
+                nearest = std::min(nearest, dx * dx + dy * dy + dz * dz);
+            }
+
+            if (nearest > best_distance) {
+                best = point;
+                best_distance = nearest;
+            }
+        }
+
+        points.push_back(best);
+    }
+
+    return points;
+}
+
+std::string poisson_table(const std::string& name, const int count, const int dimensions) {
+    /* GLSL has no zero-sized arrays, loops over count samples just never read it */
+    const auto size = std::max(count, 1);
+    auto points = best_candidates(size, dimensions);
+
+    if (dimensions == 3) {
+        for (auto i = 0; i < size; ++i) {
+            const auto& p = points[i];
+            const auto length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            const auto t = static_cast<float>(i + 1) / size;
+            const auto scale = (0.1f + 0.9f * t * t) / std::max(length, 0.0001f);
+            for (auto& c : points[i]) c *= scale;
+        }
+    }
+
+    const auto type = dimensions == 2 ? std::string{"vec2"} : std::string{"vec3"};
+    auto table = "const " + type + " " + name + "[" + std::to_string(size) + "] = " + type + "[](";
+    for (auto i = 0; i < size; ++i) {
+        char element[96];
+        if (dimensions == 2) {
+            std::snprintf(element, sizeof(element), "vec2(%.6f, %.6f)", points[i][0], points[i][1]);
+        } else {
+            std::snprintf(element, sizeof(element), "vec3(%.6f, %.6f, %.6f)", points[i][0], points[i][1], points[i][2]);
+        }
+        table += (i > 0 ? ", " : "") + std::string{element};
+    }
+
+    return table + ");\n";
+}
+
+int sample_count(const std::string& token, const expansion& e, const std::string& location) {
+    if (is_number(token)) return std::stoi(token);
+
+    const auto macro = e.int_macros.find(token);
+    if (macro == e.int_macros.end()) throw std::runtime_error{location + " - unknown sample count " + token};
+
+    return macro->second;
+}
+
+void expand_file(const std::string& file_name, expansion& e) {
+    const auto index = std::to_string(e.source.files.size());
+    e.source.files.push_back(file_name);
+    e.included.insert(file_name);
+
+    const auto text = load_file<std::string>(file_name);
+    if (text.empty()) throw std::runtime_error{file_name + " - shader is empty"};
+
+    auto lines = std::istringstream{text};
+    auto line = std::string{};
+    auto line_number = 0;
+
+    if (index == "0" && !starts_with(text, "#version")) {
+        e.source.text += e.prologue + "#line 1 0\n";
+    }
+
+    while (std::getline(lines, line)) {
+        ++line_number;
+        const auto location = file_name + ":" + std::to_string(line_number);
+
+        if (line_number == 1 && index == "0" && starts_with(line, "#version")) {
+            e.source.text += line + '\n' + e.prologue + "#line 2 0\n";
+        } else if (starts_with(line, "#include")) {
+            const auto open = line.find('"');
+            const auto close = line.find('"', open + 1);
+            if (open == std::string::npos || close == std::string::npos) {
+                throw std::runtime_error{location + " - malformed #include"};
+            }
+
+            const auto included_name = directory_of(file_name) + line.substr(open + 1, close - open - 1);
+            if (e.included.count(included_name) == 0) {
+                e.source.text += "#line 1 " + std::to_string(e.source.files.size()) + '\n';
+                expand_file(included_name, e);
+                e.source.text += "#line " + std::to_string(line_number + 1) + ' ' + index + '\n';
+            } else {
+                e.source.text += '\n';
+            }
+        } else if (starts_with(line, "#poisson_disk") || starts_with(line, "#poisson_sphere")) {
+            auto tokens = std::istringstream{line};
+            auto directive = std::string{}, name = std::string{}, count = std::string{};
+            tokens >> directive >> name >> count;
+            if (name.empty() || count.empty()) throw std::runtime_error{location + " - malformed " + directive};
+
+            e.source.text += poisson_table(name, sample_count(count, e, location),
+                directive == "#poisson_disk" ? 2 : 3);
+        } else {
+            if (starts_with(line, "#define")) track_defines(line, e);
+            e.source.text += line + '\n';
+        }
+    }
+}
+
+} /* namespace */
+
+void set_shader_constant(const std::string& name, const int value) {
+    std::lock_guard<std::mutex> lock{sources_mutex};
+
+    constants += "#define " + name + ' ' + std::to_string(value) + '\n';
+    sources.clear();
+}
+
+shader_source preprocess_shader(const std::string& file_name, const std::string& defines) {
+    const auto key = file_name + '\n' + defines;
+
+    auto e = expansion{};
+    {
+        std::lock_guard<std::mutex> lock{sources_mutex};
+
+        const auto cached = sources.find(key);
+        if (cached != sources.end()) return cached->second;
+
+        e.prologue = constants + defines;
+    }
+
+    track_defines(e.prologue, e);
+    expand_file(file_name, e);
+
+    std::lock_guard<std::mutex> lock{sources_mutex};
+    sources[key] = e.source;
+    return e.source;
+}
+
+std::set<std::string> invalidate_shader_sources(const std::set<std::string>& files) {
+    std::lock_guard<std::mutex> lock{sources_mutex};
+
+    auto affected = files;
+    for (auto it = sources.begin(); it != sources.end(); ) {
+        const auto& read = it->second.files;
+        const auto stale = std::any_of(std::begin(read), std::end(read),
+            [&files] (const std::string& file) { return files.count(file) != 0; });
+
+        if (stale) {
+            affected.insert(read.front());
+            it = sources.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    return affected;
+}
+
+} /* namespace gl */
@@ -0,0 +1,32 @@
+#ifndef gl_shader_source_h
+#define gl_shader_source_h
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace gl {
+
+struct shader_source {
+    std::string text;
+    /* indexed by the source string number used in the #line directives */
+    std::vector<std::string> files;
+};
+
+/* Injected as "#define name value" into every shader loaded afterwards, ahead of the per-program defines. */
+void set_shader_constant(const std::string& name, int value);
+
+/* Expands the extra directives below and emits #line directives so compiler messages point into the right file.
+ *   #include "file"             relative to the including file, each file is included once
+ *   #poisson_disk name count     const vec2 name[count], points in the unit disk
+ *   #poisson_sphere name count   const vec3 name[count], points in the unit sphere, denser towards the center
+ * count is a number or the name of a macro defined before as a number. defines are inserted after #version.
+ * Results are cached by file name and defines. Safe to call from any thread. */
+shader_source preprocess_shader(const std::string& file_name, const std::string& defines);
+
+/* Drops the cached results that read any of files. Returns files plus every file that included one of them. */
+std::set<std::string> invalidate_shader_sources(const std::set<std::string>& files);
+
+} /* namespace gl */
+
+#endif /* gl_shader_source_h */
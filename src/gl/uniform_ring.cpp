@@ -0,0 +1,86 @@
+#include "uniform_ring.h"
+#include <chrono>
+#include <stdexcept>
+
+namespace gl {
+
+void uniform_ring::create(const GLsizeiptr requested_size) {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    size = (requested_size + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &buffer_id);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+
+    if (GLEW_ARB_buffer_storage) {
+        const auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+        persistent = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+        if (!persistent) throw std::runtime_error{"could not map the uniform ring"};
+    } else {
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+}
+
+GLintptr uniform_ring::allocate(const GLsizeiptr slice_size) {
+    if (slice_size > size) throw std::runtime_error{"uniform block larger than the uniform ring"};
+
+    auto begin = (position + alignment - 1) / alignment * alignment;
+    if (begin % size + slice_size > size) begin += size - begin % size;
+
+    const auto end = begin + slice_size;
+
+    /* a frame that outgrows the ring fences what it wrote so far and then waits on it like on an older frame */
+    if (end - frame_begin > size) {
+        fence_frame();
+        frame_begin = begin;
+        ++frame.mid_frame_fences;
+    }
+
+    /* a slice reuses the bytes of positions size earlier, the oldest region is always the first one reached */
+    while (!regions.empty() && regions.front().begin + size < end) {
+        wait(regions.front());
+        glDeleteSync(regions.front().fence);
+        regions.pop_front();
+    }
+
+    position = end;
+    frame.bytes_written += slice_size;
+    return static_cast<GLintptr>(begin % size);
+}
+
+char* uniform_ring::map(const GLintptr offset, const GLsizeiptr slice_size) {
+    if (persistent) return persistent + offset;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+    const auto flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+    return static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, offset, slice_size, flags));
+}
+
+void uniform_ring::unmap() {
+    if (!persistent) glUnmapBuffer(GL_UNIFORM_BUFFER);
+}
+
+void uniform_ring::wait(const region& r) {
+    if (glClientWaitSync(r.fence, 0, 0) != GL_TIMEOUT_EXPIRED) return;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    while (glClientWaitSync(r.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+    const auto end = std::chrono::high_resolution_clock::now();
+
+    ++frame.fence_waits;
+    frame.fence_wait_ms += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void uniform_ring::fence_frame() {
+    if (position > frame_begin) regions.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frame_begin });
+}
+
+void uniform_ring::end_frame() {
+    fence_frame();
+    frame_begin = position;
+
+    last_frame = frame;
+    frame = {};
+}
+
+} /* namespace gl */
@@ -0,0 +1,78 @@
+#ifndef gl_uniform_ring_h
+#define gl_uniform_ring_h
+
+#include "gl_include.h"
+#include <cstring>
+#include <deque>
+
+namespace gl {
+
+struct uniform_ring_stats {
+    size_t bytes_written;
+    unsigned fence_waits;
+    double fence_wait_ms;
+    unsigned mid_frame_fences;
+};
+
+/* Streams uniform blocks through one buffer: every write gets a fresh slice which is bound with
+ * glBindBufferRange, so no slice is ever overwritten while a draw may still read it. The slices of a frame
+ * are guarded by one fence, and writes only wait on it once the ring has wrapped around to them. A frame
+ * writing more than the ring holds gets fenced early and waits on its own first slices.
+ * The buffer stays mapped with GL_ARB_buffer_storage, otherwise each slice is mapped unsynchronized. */
+class uniform_ring {
+public:
+    uniform_ring() = default;
+    uniform_ring(const uniform_ring&) = delete;
+    uniform_ring& operator=(const uniform_ring&) = delete;
+
+    void create(GLsizeiptr size);
+
+    /* fill(char* dst) writes size bytes, the slice is then bound to binding_point. */
+    template<typename fill_fn>
+    void write(const GLuint binding_point, const GLsizeiptr size, fill_fn fill) {
+        const auto offset = allocate(size);
+        fill(map(offset, size));
+        unmap();
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding_point, buffer_id, offset, size);
+    }
+
+    template<typename T>
+    void write(const GLuint binding_point, const T& block) {
+        write(binding_point, sizeof(block), [&block] (char* dst) { std::memcpy(dst, &block, sizeof(block)); });
+    }
+
+    /* Fences the slices written since the previous call, call once per frame after its draws. */
+    void end_frame();
+
+    /* Totals of the last finished frame. */
+    const uniform_ring_stats& stats() const { return last_frame; }
+
+private:
+    struct region {
+        GLsync fence;
+        long long begin;
+    };
+
+    GLintptr allocate(GLsizeiptr size);
+    void fence_frame();
+    char* map(GLintptr offset, GLsizeiptr size);
+    void unmap();
+    void wait(const region& r);
+
+    GLuint buffer_id = 0;
+    GLsizeiptr size = 0;
+    GLint alignment = 256;
+    char* persistent = nullptr;
+
+    /* positions grow monotonically, the buffer offset is position % size */
+    long long position = 0;
+    long long frame_begin = 0;
+    std::deque<region> regions;
+
+    uniform_ring_stats frame = {};
+    uniform_ring_stats last_frame = {};
+};
+
+} /* namespace gl */
+
+#endif /* gl_uniform_ring_h */
@@ -1,40 +1,224 @@
 #include "util.h"
 #include "picopng.h"
+#include "shader_source.h"
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <map>
+#include <set>
 
 namespace gl {
 
-GLuint load_shader(const char* file_name, const GLenum type) {
-    const auto shader_src = load_file<std::string>(file_name);
-    if (shader_src.empty()) throw std::runtime_error{std::string{file_name} + " - shader is empty"};
+namespace {
+
+struct {
+    std::string dir;
+    std::string driver;
+    std::map<std::string, GLuint> shaders;
+    std::map<GLuint, std::vector<std::string>> shader_files;
+    std::map<GLuint, unsigned> shader_users;
+    std::map<GLuint, std::string> pending_binaries;
+    std::set<GLuint> linked_programs;
+    program_cache_stats stats;
+    bool parallel_compile;
+} program_cache;
+
+struct decoded_png {
+    std::vector<uint8_t> bytes;
+    unsigned long width;
+    unsigned long height;
+};
+
+std::map<std::string, std::future<decoded_png>> png_prefetches;
+
+decoded_png decode_png_file(const std::string& name) {
+    const auto png_bytes = load_file<std::vector<uint8_t>>(name);
+
+    auto png = decoded_png{};
+    const auto ret_code = decodePNG(png.bytes, png.width, png.height, png_bytes.data(), png_bytes.size());
+    if (ret_code) throw std::runtime_error{"decodePNG() failed"};
+
+    return png;
+}
+
+const char* cube_face_names[] { "posx", "negx", "posy", "negy", "posz", "negz" };
+
+std::string cache_path(const std::string& key) {
+    auto hash = uint64_t{14695981039346656037ull};
+    for (auto c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return program_cache.dir + '/' + name + ".bin";
+}
+
+bool load_program_binary(const GLuint program_id, const std::string& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file) return false;
+
+    auto format = GLenum{};
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    const auto binary = std::vector<char>(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+    if (!file.eof() || binary.empty()) return false;
+
+    glProgramBinary(program_id, format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    GLint linked;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked);
+    return linked != 0;
+}
+
+void save_program_binary(const GLuint program_id, const std::string& path) {
+    GLint length = 0;
+    glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    auto binary = std::vector<char>(length);
+    auto format = GLenum{};
+    glGetProgramBinary(program_id, length, nullptr, &format, binary.data());
+
+    std::ofstream file{path, std::ios::binary};
+    file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    file.write(binary.data(), binary.size());
+}
+
+} /* namespace */
+
+void enable_program_cache(const std::string& dir) {
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    if (format_count == 0) return;
+
+    program_cache.dir = dir;
+    program_cache.driver = std::string{reinterpret_cast<const char*>(glGetString(GL_VENDOR))} + '\n' +
+        reinterpret_cast<const char*>(glGetString(GL_RENDERER)) + '\n' +
+        reinterpret_cast<const char*>(glGetString(GL_VERSION));
+}
+
+program_cache_stats get_program_cache_stats() {
+    return program_cache.stats;
+}
+
+namespace {
+
+void forget_shader(const GLuint shader_id) {
+    for (auto it = program_cache.shaders.begin(); it != program_cache.shaders.end(); ++it) {
+        if (it->second != shader_id) continue;
+        program_cache.shaders.erase(it);
+        break;
+    }
+    program_cache.shader_files.erase(shader_id);
+    program_cache.shader_users.erase(shader_id);
+    glDeleteShader(shader_id);
+}
+
+/* Empty if the shader compiled, otherwise the info log. A failed shader is removed from the cache. */
+std::string shader_error(const GLuint shader_id) {
+    GLint compiled;
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled);
+    if (compiled) return std::string{};
+
+    GLint info_len = 0;
+    glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &info_len);
+
+    auto info = std::string(info_len, char{});
+    glGetShaderInfoLog(shader_id, info_len, nullptr, &info[0]);
+
+    const auto files = program_cache.shader_files[shader_id];
+    forget_shader(shader_id);
+
+    auto message = "glCompileShader(\"" + files.front() + "\") failed:\n" + info;
+    if (files.size() > 1) {
+        message += "source strings:";
+        for (size_t i = 0; i < files.size(); ++i) message += ' ' + std::to_string(i) + '=' + files[i];
+    }
+    return message;
+}
+
+void check_shader(const GLuint shader_id) {
+    const auto error = shader_error(shader_id);
+    if (!error.empty()) throw std::runtime_error{error};
+}
+
+std::vector<GLuint> attached_shaders(const GLuint program_id) {
+    GLint shader_count = 0;
+    glGetProgramiv(program_id, GL_ATTACHED_SHADERS, &shader_count);
+    auto shader_ids = std::vector<GLuint>(shader_count);
+    if (shader_count > 0) glGetAttachedShaders(program_id, shader_count, nullptr, shader_ids.data());
+
+    return shader_ids;
+}
+
+/* The compile status isn't queried here so the driver can keep compiling while more work is issued,
+ * failures are reported by check_shader() when the program doesn't link. */
+GLuint compile_shader(const GLenum type, const shader_source& src) {
+    const auto key = std::to_string(type) + '\n' + src.text;
+    const auto cached = program_cache.shaders.find(key);
+    if (cached != program_cache.shaders.end()) {
+        ++program_cache.stats.shaders_reused;
+        return cached->second;
+    }
 
     const auto shader_id = glCreateShader(type);
     if (!shader_id) throw std::runtime_error{"glCreateShader() failed"};
 
-    const GLchar* src_array[] { shader_src.data() };
+    const GLchar* src_array[] { src.text.data() };
     glShaderSource(shader_id, 1, src_array, nullptr);
     glCompileShader(shader_id);
 
-    GLint compiled;
-    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled);
+    ++program_cache.stats.shaders_compiled;
+    program_cache.shaders[key] = shader_id;
+    program_cache.shader_files[shader_id] = src.files;
+    return shader_id;
+}
 
-    if (!compiled) {
-        GLint info_len = 0;
-        glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &info_len);
+GLuint create_shader_program(const std::pair<const char*, GLenum>* shaders, const size_t count,
+    const std::vector<shader_source>& sources) {
 
-        auto info = std::string(info_len, char{});
-        glGetShaderInfoLog(shader_id, info_len, nullptr, &info[0]);
+    auto key = program_cache.driver;
+    for (size_t i = 0; i < count; ++i) key += '\n' + std::to_string(shaders[i].second) + '\n' + sources[i].text;
+
+    const auto program_id = glCreateProgram();
+    if (!program_id) throw std::runtime_error{"glCreateProgram() failed"};
 
-        glDeleteShader(shader_id);
+    if (!program_cache.dir.empty()) {
+        const auto path = cache_path(key);
+        if (load_program_binary(program_id, path)) {
+            ++program_cache.stats.binary_hits;
+            program_cache.linked_programs.insert(program_id);
+            return program_id;
+        }
 
-        throw std::runtime_error{std::string{"glCompileShader(\""} + file_name + "\") failed:\n" + info};
+        ++program_cache.stats.binary_misses;
+        program_cache.pending_binaries[program_id] = path;
+        glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     }
 
-    return shader_id;
+    for (size_t i = 0; i < count; ++i) {
+        const auto shader_id = compile_shader(shaders[i].second, sources[i]);
+        glAttachShader(program_id, shader_id);
+        ++program_cache.shader_users[shader_id];
+    }
+
+    return program_id;
 }
 
-void link_shader_program(const GLuint program_id, const bool delete_on_fail) {
+void submit_shader_program(const GLuint program_id) {
+    if (program_cache.linked_programs.count(program_id) != 0) return;
+
     glLinkProgram(program_id);
+}
+
+void finish_shader_program(const GLuint program_id, const bool delete_on_fail) {
+    if (program_cache.linked_programs.erase(program_id) != 0) return;
+
+    const auto pending_binary = program_cache.pending_binaries.find(program_id);
+    const auto binary_path = pending_binary != program_cache.pending_binaries.end()
+        ? pending_binary->second : std::string{};
+    if (pending_binary != program_cache.pending_binaries.end()) program_cache.pending_binaries.erase(pending_binary);
 
     GLint linked;
     glGetProgramiv(program_id, GL_LINK_STATUS, &linked);
@@ -47,20 +231,270 @@ void link_shader_program(const GLuint program_id, const bool delete_on_fail) {
         auto info = std::string(info_len, char{});
         glGetProgramInfoLog(program_id, info_len, nullptr, &info[0]);
 
-        if (delete_on_fail) glDeleteProgram(program_id);
+        auto message = "glLinkProgram() failed:\n" + info;
+        for (const auto shader_id : attached_shaders(program_id)) {
+            const auto error = shader_error(shader_id);
+            if (!error.empty()) {
+                message = error;
+                break;
+            }
+        }
 
-        throw std::runtime_error{"glLinkProgram() failed:\n" + info};
+        if (delete_on_fail) delete_shader_program(program_id);
+
+        throw std::runtime_error{message};
     }
+
+    if (!binary_path.empty()) save_program_binary(program_id, binary_path);
 }
 
-std::vector<uint8_t> load_png_bytes(const std::string& name, unsigned long& width, unsigned long& height) {
-    const auto png_bytes = load_file<std::vector<uint8_t>>(name);
+} /* namespace */
 
-    auto image_bytes = std::vector<uint8_t>{};
-    const auto ret_code = decodePNG(image_bytes, width, height, png_bytes.data(), png_bytes.size());
-    if (ret_code) throw std::runtime_error{"decodePNG() failed"};
+void delete_shader_program(const GLuint program_id) {
+    const auto shader_ids = attached_shaders(program_id);
+    glDeleteProgram(program_id);
 
-    return image_bytes;
+    for (const auto shader_id : shader_ids) {
+        const auto users = program_cache.shader_users.find(shader_id);
+        if (users != program_cache.shader_users.end() && --users->second == 0) forget_shader(shader_id);
+    }
+}
+
+GLuint load_shader(const char* file_name, const GLenum type, const std::string& defines) {
+    const auto shader_id = compile_shader(type, preprocess_shader(file_name, defines));
+    check_shader(shader_id);
+
+    return shader_id;
+}
+
+GLuint load_shader_program(const std::pair<const char*, GLenum>* shaders, const size_t count,
+    const std::string& defines) {
+
+    auto sources = std::vector<shader_source>{};
+    for (size_t i = 0; i < count; ++i) sources.push_back(preprocess_shader(shaders[i].first, defines));
+
+    return create_shader_program(shaders, count, sources);
+}
+
+void link_shader_program(const GLuint program_id, const bool delete_on_fail) {
+    submit_shader_program(program_id);
+    finish_shader_program(program_id, delete_on_fail);
+}
+
+program_batch::program_batch(const std::set<std::string>& changed_files)
+    : changed_files(invalidate_shader_sources(changed_files)) {}
+
+void program_batch::add(std::vector<std::pair<const char*, GLenum>> shaders, on_linked_fn on_linked,
+    const std::string& defines, const GLuint previous_program_id) {
+
+    if (!changed_files.empty()) {
+        const auto changed = std::any_of(std::begin(shaders), std::end(shaders),
+            [this] (const std::pair<const char*, GLenum>& shader) { return changed_files.count(shader.first) != 0; });
+        if (!changed) return;
+    }
+
+    auto added_entry = entry{};
+    added_entry.sources = std::async(std::launch::async, [shaders, defines] {
+        auto sources = std::vector<shader_source>{};
+        for (const auto& shader : shaders) sources.push_back(preprocess_shader(shader.first, defines));
+        return sources;
+    });
+    added_entry.shaders = std::move(shaders);
+    added_entry.on_linked = std::move(on_linked);
+    added_entry.previous_program_id = previous_program_id;
+    added_entry.program_id = 0;
+
+    added.push_back(std::move(added_entry));
+}
+
+bool program_batch::empty() const {
+    return added.empty() && submitted.empty();
+}
+
+void program_batch::fail(const entry& failed, const std::exception& e) {
+    if (failed.previous_program_id == 0) throw;
+
+    failures.push_back(e.what());
+}
+
+void program_batch::submit() {
+    if (!program_cache.parallel_compile && GLEW_KHR_parallel_shader_compile) {
+        /* lets the driver choose the number of compiler threads */
+        glMaxShaderCompilerThreadsKHR(0xffffffff);
+        program_cache.parallel_compile = true;
+    }
+
+    for (auto& submitted_entry : added) {
+        try {
+            const auto sources = submitted_entry.sources.get();
+            submitted_entry.program_id = create_shader_program(submitted_entry.shaders.data(),
+                submitted_entry.shaders.size(), sources);
+            submit_shader_program(submitted_entry.program_id);
+        } catch (const std::exception& e) {
+            fail(submitted_entry, e);
+        }
+
+        submitted.push_back(std::move(submitted_entry));
+    }
+    added.clear();
+}
+
+bool program_batch::ready() const {
+    if (!program_cache.parallel_compile) return true;
+
+    return std::all_of(std::begin(submitted), std::end(submitted), [] (const entry& submitted_entry) {
+        if (submitted_entry.program_id == 0) return true;
+
+        GLint completed = GL_TRUE;
+        glGetProgramiv(submitted_entry.program_id, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed != GL_FALSE;
+    });
+}
+
+void program_batch::finish() {
+    submit();
+
+    auto finished = std::move(submitted);
+    submitted.clear();
+
+    for (auto& finished_entry : finished) {
+        if (finished_entry.program_id == 0) continue;
+
+        try {
+            finish_shader_program(finished_entry.program_id, true);
+        } catch (const std::exception& e) {
+            fail(finished_entry, e);
+            continue;
+        }
+
+        finished_entry.on_linked(finished_entry.program_id);
+
+        if (finished_entry.previous_program_id != 0) {
+            copy_uniforms(finished_entry.previous_program_id, finished_entry.program_id);
+            delete_shader_program(finished_entry.previous_program_id);
+        }
+    }
+}
+
+const std::vector<std::string>& program_batch::errors() const {
+    return failures;
+}
+
+void copy_uniform(const GLuint src_program_id, const GLint src_loc,
+    const GLuint dst_program_id, const GLint dst_loc, const GLenum type) {
+
+    GLfloat floats[16];
+    GLint ints[4];
+    GLuint uints[4];
+
+    switch (type) {
+    case GL_FLOAT:
+    case GL_FLOAT_VEC2:
+    case GL_FLOAT_VEC3:
+    case GL_FLOAT_VEC4:
+        glGetUniformfv(src_program_id, src_loc, floats);
+        if (type == GL_FLOAT) glProgramUniform1fv(dst_program_id, dst_loc, 1, floats);
+        if (type == GL_FLOAT_VEC2) glProgramUniform2fv(dst_program_id, dst_loc, 1, floats);
+        if (type == GL_FLOAT_VEC3) glProgramUniform3fv(dst_program_id, dst_loc, 1, floats);
+        if (type == GL_FLOAT_VEC4) glProgramUniform4fv(dst_program_id, dst_loc, 1, floats);
+        break;
+    case GL_FLOAT_MAT3:
+        glGetUniformfv(src_program_id, src_loc, floats);
+        glProgramUniformMatrix3fv(dst_program_id, dst_loc, 1, GL_FALSE, floats);
+        break;
+    case GL_FLOAT_MAT4:
+        glGetUniformfv(src_program_id, src_loc, floats);
+        glProgramUniformMatrix4fv(dst_program_id, dst_loc, 1, GL_FALSE, floats);
+        break;
+    case GL_UNSIGNED_INT:
+    case GL_UNSIGNED_INT_VEC2:
+    case GL_UNSIGNED_INT_VEC3:
+    case GL_UNSIGNED_INT_VEC4:
+        glGetUniformuiv(src_program_id, src_loc, uints);
+        if (type == GL_UNSIGNED_INT) glProgramUniform1uiv(dst_program_id, dst_loc, 1, uints);
+        if (type == GL_UNSIGNED_INT_VEC2) glProgramUniform2uiv(dst_program_id, dst_loc, 1, uints);
+        if (type == GL_UNSIGNED_INT_VEC3) glProgramUniform3uiv(dst_program_id, dst_loc, 1, uints);
+        if (type == GL_UNSIGNED_INT_VEC4) glProgramUniform4uiv(dst_program_id, dst_loc, 1, uints);
+        break;
+    case GL_INT_VEC2:
+    case GL_BOOL_VEC2:
+        glGetUniformiv(src_program_id, src_loc, ints);
+        glProgramUniform2iv(dst_program_id, dst_loc, 1, ints);
+        break;
+    case GL_INT_VEC3:
+    case GL_BOOL_VEC3:
+        glGetUniformiv(src_program_id, src_loc, ints);
+        glProgramUniform3iv(dst_program_id, dst_loc, 1, ints);
+        break;
+    case GL_INT_VEC4:
+    case GL_BOOL_VEC4:
+        glGetUniformiv(src_program_id, src_loc, ints);
+        glProgramUniform4iv(dst_program_id, dst_loc, 1, ints);
+        break;
+    default:
+        /* int, bool and all sampler types */
+        glGetUniformiv(src_program_id, src_loc, ints);
+        glProgramUniform1iv(dst_program_id, dst_loc, 1, ints);
+        break;
+    }
+}
+
+void copy_uniforms(const GLuint src_program_id, const GLuint dst_program_id) {
+    GLint uniform_count = 0, max_name_len = 0;
+    glGetProgramiv(src_program_id, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glGetProgramiv(src_program_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_len);
+
+    auto name = std::string(max_name_len, char{});
+    for (auto i = 0; i < uniform_count; ++i) {
+        GLsizei name_len;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(src_program_id, i, max_name_len, &name_len, &size, &type, &name[0]);
+
+        auto base_name = name.substr(0, name_len);
+        if (base_name.size() > 3 && base_name.compare(base_name.size() - 3, 3, "[0]") == 0) {
+            base_name.resize(base_name.size() - 3);
+        }
+
+        for (auto element = 0; element < size; ++element) {
+            const auto element_name = size > 1 ? base_name + '[' + std::to_string(element) + ']' : base_name;
+            const auto src_loc = glGetUniformLocation(src_program_id, element_name.c_str());
+            const auto dst_loc = glGetUniformLocation(dst_program_id, element_name.c_str());
+            if (src_loc < 0 || dst_loc < 0) continue;
+
+            copy_uniform(src_program_id, src_loc, dst_program_id, dst_loc, type);
+        }
+    }
+}
+
+void prefetch_png_files(const std::vector<std::string>& names) {
+    for (const auto& name : names) {
+        if (png_prefetches.count(name) != 0) continue;
+        png_prefetches[name] = std::async(std::launch::async, decode_png_file, name);
+    }
+}
+
+void prefetch_png_texture_cube(const char* name) {
+    auto names = std::vector<std::string>{};
+    for (const auto face_name : cube_face_names) names.push_back(std::string{name} + '/' + face_name + ".png");
+
+    prefetch_png_files(names);
+}
+
+std::vector<uint8_t> load_png_bytes(const std::string& name, unsigned long& width, unsigned long& height) {
+    const auto prefetched = png_prefetches.find(name);
+    auto png = decoded_png{};
+    if (prefetched != png_prefetches.end()) {
+        auto decoding = std::move(prefetched->second);
+        png_prefetches.erase(prefetched);
+        png = decoding.get();
+    } else {
+        png = decode_png_file(name);
+    }
+
+    width = png.width;
+    height = png.height;
+    return std::move(png.bytes);
 }
 
 GLuint load_png_texture(const char* name) {
@@ -86,11 +520,9 @@ GLuint load_png_texture_cube(const char* name) {
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    const char* face_names[] { "posx", "negx", "posy", "negy", "posz", "negz" };
-
     for (auto face = 0; face < 6; ++face) {
         unsigned long width, height;
-        const auto bytes = load_png_bytes(std::string{name} + '/' + face_names[face] + ".png", width, height);
+        const auto bytes = load_png_bytes(std::string{name} + '/' + cube_face_names[face] + ".png", width, height);
         glTexImage2D(
             GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA,
             width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, bytes.data()
@@ -100,4 +532,51 @@ GLuint load_png_texture_cube(const char* name) {
     return tex_id;
 }
 
+std::vector<uint8_t> resample_rgba(const std::vector<uint8_t>& bytes,
+    const unsigned long width, const unsigned long height,
+    const unsigned long new_width, const unsigned long new_height
+) {
+    if (width == new_width && height == new_height) return bytes;
+
+    auto resampled = std::vector<uint8_t>(new_width * new_height * 4);
+    for (unsigned long y = 0; y < new_height; ++y) {
+        const auto src_y = y * height / new_height;
+        for (unsigned long x = 0; x < new_width; ++x) {
+            const auto src_x = x * width / new_width;
+            for (auto c = 0; c < 4; ++c) {
+                resampled[(y * new_width + x) * 4 + c] = bytes[(src_y * width + src_x) * 4 + c];
+            }
+        }
+    }
+
+    return resampled;
+}
+
+GLuint load_png_texture_array(const std::vector<std::string>& names,
+    const unsigned long width, const unsigned long height
+) {
+    GLuint tex_id;
+    glGenTextures(1, &tex_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex_id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, width, height, names.size(),
+        0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    for (size_t layer = 0; layer < names.size(); ++layer) {
+        unsigned long layer_width, layer_height;
+        const auto bytes = resample_rgba(load_png_bytes(names[layer], layer_width, layer_height),
+            layer_width, layer_height, width, height);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1,
+            GL_RGBA, GL_UNSIGNED_BYTE, bytes.data());
+    }
+
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    return tex_id;
+}
+
 } /* namespace gl */
@@ -2,11 +2,15 @@
 #define gl_util_h
 
 #include "gl_include.h"
+#include "shader_source.h"
 #include <vector>
+#include <set>
 #include <string>
 #include <fstream>
 #include <iterator>
 #include <stdexcept>
+#include <functional>
+#include <future>
 
 namespace gl {
 
@@ -18,25 +22,105 @@ container load_file(const std::string& name) {
     return container(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
 }
 
-GLuint load_shader(const char* file_name, GLenum type);
+struct program_cache_stats {
+    unsigned binary_hits;
+    unsigned binary_misses;
+    unsigned shaders_compiled;
+    unsigned shaders_reused;
+};
 
-template<size_t N>
-GLuint load_shader_program(const std::pair<const char*, GLenum> (&shaders)[N]) {
-    const auto program_id = glCreateProgram();
-    if (!program_id) throw std::runtime_error{"glCreateProgram() failed"};
+/* Programs loaded after this call are looked up in dir by a hash of their final sources and the driver,
+ * and stored there as program binaries after linking. Does nothing if the driver has no binary formats. */
+void enable_program_cache(const std::string& dir);
+program_cache_stats get_program_cache_stats();
 
-    for (auto& shader : shaders) {
-        const auto shader_id = load_shader(shader.first, shader.second);
-        glAttachShader(program_id, shader_id);
-    }
+/* Sources go through preprocess_shader(), defines are inserted right after the #version line,
+ * e.g. "#define SAMPLE_COUNT 8\n". Identical stages are compiled once and shared between programs. */
+GLuint load_shader(const char* file_name, GLenum type, const std::string& defines = std::string{});
+
+/* The returned program may already be linked from a cached binary, link_shader_program() is still required. */
+GLuint load_shader_program(const std::pair<const char*, GLenum>* shaders, size_t count, const std::string& defines);
 
-    return program_id;
+template<size_t N>
+GLuint load_shader_program(const std::pair<const char*, GLenum> (&shaders)[N],
+    const std::string& defines = std::string{}) {
+
+    return load_shader_program(shaders, N, defines);
 }
 
 void link_shader_program(GLuint program_id, bool delete_on_fail = true);
 
+/* Also deletes the cached shaders no other program uses anymore. */
+void delete_shader_program(GLuint program_id);
+
+/* Collects programs so their sources are read and preprocessed on worker threads, and all compiles and links
+ * are issued before any status is queried. With GL_KHR_parallel_shader_compile the driver builds them
+ * concurrently, otherwise they still overlap whatever the caller does between submit() and finish().
+ *
+ * A program added with a previous program id replaces it: the previous uniform values are copied over
+ * after on_linked and the previous program is deleted. If the replacement fails to build the previous
+ * program is kept and the failure is reported in errors() instead of being thrown. */
+class program_batch {
+public:
+    using on_linked_fn = std::function<void(GLuint program_id)>;
+
+    program_batch() = default;
+
+    /* Only programs that use one of changed_files, directly or through #include, are added. */
+    explicit program_batch(const std::set<std::string>& changed_files);
+
+    void add(std::vector<std::pair<const char*, GLenum>> shaders, on_linked_fn on_linked,
+        const std::string& defines = std::string{}, GLuint previous_program_id = 0);
+
+    template<size_t N>
+    void add(const std::pair<const char*, GLenum> (&shaders)[N], on_linked_fn on_linked,
+        const std::string& defines = std::string{}, const GLuint previous_program_id = 0) {
+
+        add({ std::begin(shaders), std::end(shaders) }, std::move(on_linked), defines, previous_program_id);
+    }
+
+    bool empty() const;
+
+    /* Compiles and links everything added so far without waiting for the results. */
+    void submit();
+
+    /* True once every submitted program can be finished without blocking.
+     * Always true without GL_KHR_parallel_shader_compile. */
+    bool ready() const;
+
+    /* Waits for every program in the order added and calls its on_linked. */
+    void finish();
+
+    const std::vector<std::string>& errors() const;
+
+private:
+    struct entry {
+        std::vector<std::pair<const char*, GLenum>> shaders;
+        std::future<std::vector<shader_source>> sources;
+        on_linked_fn on_linked;
+        GLuint previous_program_id;
+        GLuint program_id;
+    };
+
+    void fail(const entry& failed, const std::exception& e);
+
+    std::set<std::string> changed_files;
+    std::vector<entry> added;
+    std::vector<entry> submitted;
+    std::vector<std::string> failures;
+};
+
+/* Copies the values of default-block uniforms present in both linked programs,
+ * so a rebuilt variant starts with the state of the one it replaces. */
+void copy_uniforms(GLuint src_program_id, GLuint dst_program_id);
+
+/* Starts decoding the files on worker threads, the load_png_texture*() calls that need them pick up the result. */
+void prefetch_png_files(const std::vector<std::string>& names);
+void prefetch_png_texture_cube(const char* name);
+
 GLuint load_png_texture(const char* name);
 GLuint load_png_texture_cube(const char* name);
+GLuint load_png_texture_array(const std::vector<std::string>& names, unsigned long width, unsigned long height);
 
 } /* namespace gl */
 
@@ -0,0 +1,152 @@
+#include "job_system.h"
+
+namespace {
+
+thread_local const job_system* current_system = nullptr;
+thread_local unsigned current_queue = 0;
+
+} /* namespace */
+
+job_system::job_system(const unsigned thread_count) : queued(0), stopping(false) {
+    const auto count = std::max(1u, thread_count ? thread_count : std::thread::hardware_concurrency());
+
+    for (auto i = 0u; i < count; ++i) queues.emplace_back(new queue{});
+    for (auto i = 1u; i < count; ++i) workers.emplace_back([this, i] { work(i); });
+}
+
+job_system::~job_system() {
+    {
+        std::lock_guard<std::mutex> lock{sleep_mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers) worker.join();
+}
+
+unsigned job_system::queue_index() const {
+    return current_system == this ? current_queue : 0;
+}
+
+void job_system::push(job j) {
+    auto& q = *queues[queue_index()];
+    {
+        std::lock_guard<std::mutex> lock{q.mutex};
+        q.jobs.push_back(std::move(j));
+    }
+    ++queued;
+
+    /* a worker checks queued under sleep_mutex before it sleeps, so taking it here cannot miss one */
+    { std::lock_guard<std::mutex> lock{sleep_mutex}; }
+    wake.notify_one();
+}
+
+void job_system::run(job_counter& counter, std::function<void()> job) {
+    ++counter.pending;
+    push({ std::move(job), &counter });
+}
+
+void job_system::run_after(job_counter& dependency, job_counter& counter, std::function<void()> job) {
+    ++counter.pending;
+    auto error = std::exception_ptr{};
+
+    {
+        std::lock_guard<std::mutex> lock{dependency.continuations_mutex};
+        if (dependency.pending != 0) {
+            dependency.continuations.push_back({ std::move(job), &counter });
+            return;
+        }
+        error = dependency.error;
+    }
+
+    if (error) fail(counter, error);
+    else push({ std::move(job), &counter });
+}
+
+void job_system::finish(job_counter& counter) {
+    auto ready = std::vector<job>{};
+    auto error = std::exception_ptr{};
+    {
+        std::lock_guard<std::mutex> lock{counter.continuations_mutex};
+        if (--counter.pending != 0) return;
+        ready.swap(counter.continuations);
+        error = counter.error;
+    }
+
+    for (auto& j : ready) {
+        if (error) fail(*j.counter, error);
+        else push(std::move(j));
+    }
+}
+
+void job_system::fail(job_counter& counter, std::exception_ptr error) {
+    {
+        std::lock_guard<std::mutex> lock{counter.continuations_mutex};
+        if (!counter.error) counter.error = std::move(error);
+    }
+    finish(counter);
+}
+
+bool job_system::try_run(const unsigned index) {
+    auto j = job{};
+    auto found = false;
+
+    /* newest from the own deque, which is likely still in cache, otherwise the oldest of another */
+    for (size_t i = 0; i < queues.size() && !found; ++i) {
+        auto& q = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock{q.mutex};
+        if (q.jobs.empty()) continue;
+
+        if (i == 0) {
+            j = std::move(q.jobs.back());
+            q.jobs.pop_back();
+        } else {
+            j = std::move(q.jobs.front());
+            q.jobs.pop_front();
+        }
+        found = true;
+    }
+
+    if (!found) return false;
+
+    --queued;
+    try {
+        j.fn();
+    } catch (...) {
+        fail(*j.counter, std::current_exception());
+        return true;
+    }
+    finish(*j.counter);
+    return true;
+}
+
+void job_system::drain(job_counter& counter) {
+    const auto index = queue_index();
+    while (!counter.done()) {
+        if (!try_run(index)) std::this_thread::yield();
+    }
+
+    /* the last finish() may still hold the mutex, the counter must outlive it */
+    std::lock_guard<std::mutex> lock{counter.continuations_mutex};
+}
+
+void job_system::wait(job_counter& counter) {
+    drain(counter);
+
+    auto error = std::exception_ptr{};
+    std::swap(error, counter.error);
+    if (error) std::rethrow_exception(error);
+}
+
+void job_system::work(const unsigned index) {
+    current_system = this;
+    current_queue = index;
+
+    while (true) {
+        if (try_run(index)) continue;
+
+        std::unique_lock<std::mutex> lock{sleep_mutex};
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping) return;
+    }
+}
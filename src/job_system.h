@@ -0,0 +1,111 @@
+#ifndef job_system_h
+#define job_system_h
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Counts the unfinished jobs started with it. Jobs scheduled with run_after() start once it drops to zero.
+ * The first exception thrown by one of its jobs is kept for wait(), the jobs scheduled after it are skipped. */
+class job_counter {
+public:
+    job_counter() : pending(0) {}
+    job_counter(const job_counter&) = delete;
+    job_counter& operator=(const job_counter&) = delete;
+
+    bool done() const { return pending == 0; }
+
+private:
+    friend class job_system;
+
+    struct continuation {
+        std::function<void()> fn;
+        job_counter* counter;
+    };
+
+    std::atomic<int> pending;
+    std::mutex continuations_mutex;
+    std::vector<continuation> continuations;
+    std::exception_ptr error;
+};
+
+/* Runs jobs on thread_count - 1 worker threads plus whichever thread waits. Every worker owns a deque and
+ * takes its newest job first, idle workers steal the oldest job of another deque. Threads that are not
+ * workers share one more deque, and wait() runs jobs on them too instead of blocking. */
+class job_system {
+public:
+    /* 0 uses one thread per core. */
+    explicit job_system(unsigned thread_count = 0);
+    ~job_system();
+
+    job_system(const job_system&) = delete;
+    job_system& operator=(const job_system&) = delete;
+
+    /* Including the thread that waits. */
+    unsigned thread_count() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    void run(job_counter& counter, std::function<void()> job);
+    void run_after(job_counter& dependency, job_counter& counter, std::function<void()> job);
+
+    /* Runs queued jobs until counter is done, afterwards the counter may be destroyed.
+     * Rethrows the exception of a failed job. */
+    void wait(job_counter& counter);
+
+    /* Calls body(first, last) on chunks of at most grain indices and returns when all are done.
+     * The calling thread takes the last chunk itself. */
+    template<typename body_fn>
+    void parallel_for(const size_t begin, const size_t end, const size_t grain, body_fn body) {
+        const auto chunk = std::max<size_t>(grain, 1);
+        job_counter done;
+
+        for (auto first = begin; first < end; first += chunk) {
+            const auto last = std::min(end, first + chunk);
+            if (last == end) {
+                try {
+                    body(first, last);
+                } catch (...) {
+                    /* the other chunks still reference body */
+                    drain(done);
+                    throw;
+                }
+            } else {
+                run(done, [&body, first, last] { body(first, last); });
+            }
+        }
+
+        wait(done);
+    }
+
+private:
+    using job = job_counter::continuation;
+
+    struct queue {
+        std::mutex mutex;
+        std::deque<job> jobs;
+    };
+
+    void push(job j);
+    bool try_run(unsigned index);
+    void finish(job_counter& counter);
+    void fail(job_counter& counter, std::exception_ptr error);
+    void drain(job_counter& counter);
+    void work(unsigned index);
+    unsigned queue_index() const;
+
+    /* queues[0] is shared by the threads that are not workers, worker i owns queues[i + 1] */
+    std::vector<std::unique_ptr<queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued;
+    std::atomic<bool> stopping;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+};
+
+#endif /* job_system_h */
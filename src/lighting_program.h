@@ -5,26 +5,61 @@
 #include "scope_exit.h"
 #include "gl/util.h"
 #include <string>
+#include <vector>
+
+const unsigned LIGHTING_DIFFUSE_TEXTURED = 1 << 0;
+const unsigned LIGHTING_NORMAL_TEXTURED = 1 << 1;
+const unsigned LIGHTING_REFLECTIVE = 1 << 2;
+const unsigned LIGHTING_LAYERED = 1 << 3;
+/* not an object variant: shadows of the first lights at the prepass depth, drawn as a fullscreen quad */
+const unsigned LIGHTING_SHADOW_MASK = 1 << 4;
 
 struct lighting_program {
     GLuint id;
-
-    GLuint diffuse_textured_loc;
-    GLuint normal_textured_loc;
+    unsigned features;
+
+    GLuint instanced_loc;
+    GLuint node_loc;
+    GLuint world_matrices_loc;
+    GLuint layered_loc;
+    GLuint faces_loc;
+    GLuint face_count_loc;
     GLuint diffuse_map_loc;
+    GLuint diffuse_array_loc;
     GLuint normal_map_loc;
     GLuint height_map_loc;
     GLuint occlusion_map_loc;
     GLuint reflection_map_loc;
+    GLuint scene_color_loc;
+    GLuint normal_depth_map_loc;
+    GLuint shadow_mask_loc;
+    GLuint shadow_mask_enabled_loc;
+    GLuint shadow_rotation_loc;
+    GLuint overdraw_loc;
+    GLuint clustered_loc;
+    GLuint cluster_scale_loc;
+    GLuint cluster_grid_loc;
+    GLuint cluster_indices_loc;
+    GLuint point_lights_loc;
+    GLuint reprojection_matrix_loc;
+    GLuint near_loc;
+    GLuint far_loc;
+    GLuint ssr_max_distance_loc;
+    GLuint ssr_thickness_loc;
     GLuint camera_pos_worldspace_loc;
     GLuint parallax_scale_loc;
     GLuint parallax_bias_loc;
-    GLuint shadow_samples_loc;
     GLuint shadow_distance_loc;
     GLuint depth_bias_loc;
-
-    GLuint shadow_maps_loc[MAX_LIGHTS];
-    GLuint shadow_bias_matrices_loc[MAX_LIGHTS];
+    GLuint shadow_maps_loc;
+    GLuint shadow_bias_matrices_loc;
+    GLuint shadow_rects_loc;
+    GLuint shadow_pages_loc;
+    GLuint light_views_loc;
+    GLuint cascade_splits_loc;
+    GLuint shadow_filter_loc;
+    GLuint shadow_moments_loc;
+    GLuint evsm_bleed_loc;
 };
 
 namespace {
@@ -33,33 +68,90 @@ const struct {
     const char* name;
     GLuint lighting_program::* ptr;
 } lighting_program_uniforms[] {
-    { "u_diffuse_textured", &lighting_program::diffuse_textured_loc },
-    { "u_normal_textured", &lighting_program::normal_textured_loc },
+    { "u_instanced", &lighting_program::instanced_loc },
+    { "u_node", &lighting_program::node_loc },
+    { "u_world_matrices", &lighting_program::world_matrices_loc },
+    { "u_layered", &lighting_program::layered_loc },
+    { "u_faces", &lighting_program::faces_loc },
+    { "u_face_count", &lighting_program::face_count_loc },
     { "u_diffuse_map", &lighting_program::diffuse_map_loc },
+    { "u_diffuse_array", &lighting_program::diffuse_array_loc },
     { "u_normal_map", &lighting_program::normal_map_loc },
     { "u_height_map", &lighting_program::height_map_loc },
     { "u_occlusion_map", &lighting_program::occlusion_map_loc },
     { "u_reflection_map", &lighting_program::reflection_map_loc },
+    { "u_scene_color", &lighting_program::scene_color_loc },
+    { "u_normal_depth_map", &lighting_program::normal_depth_map_loc },
+    { "u_shadow_mask", &lighting_program::shadow_mask_loc },
+    { "u_shadow_mask_enabled", &lighting_program::shadow_mask_enabled_loc },
+    { "u_shadow_rotation", &lighting_program::shadow_rotation_loc },
+    { "u_overdraw", &lighting_program::overdraw_loc },
+    { "u_clustered", &lighting_program::clustered_loc },
+    { "u_cluster_scale", &lighting_program::cluster_scale_loc },
+    { "u_cluster_grid", &lighting_program::cluster_grid_loc },
+    { "u_cluster_indices", &lighting_program::cluster_indices_loc },
+    { "u_point_lights", &lighting_program::point_lights_loc },
+    { "u_reprojection_matrix", &lighting_program::reprojection_matrix_loc },
+    { "u_near", &lighting_program::near_loc },
+    { "u_far", &lighting_program::far_loc },
+    { "u_ssr_max_distance", &lighting_program::ssr_max_distance_loc },
+    { "u_ssr_thickness", &lighting_program::ssr_thickness_loc },
     { "u_camera_pos_worldspace", &lighting_program::camera_pos_worldspace_loc },
     { "u_parallax_scale", &lighting_program::parallax_scale_loc },
     { "u_parallax_bias", &lighting_program::parallax_bias_loc },
-    { "u_shadow_samples", &lighting_program::shadow_samples_loc },
     { "u_shadow_distance", &lighting_program::shadow_distance_loc },
     { "u_depth_bias", &lighting_program::depth_bias_loc },
+    { "u_shadow_maps", &lighting_program::shadow_maps_loc },
+    { "u_shadow_bias_matrices", &lighting_program::shadow_bias_matrices_loc },
+    { "u_shadow_rects", &lighting_program::shadow_rects_loc },
+    { "u_shadow_pages", &lighting_program::shadow_pages_loc },
+    { "u_light_views", &lighting_program::light_views_loc },
+    { "u_cascade_splits", &lighting_program::cascade_splits_loc },
+    { "u_shadow_filter", &lighting_program::shadow_filter_loc },
+    { "u_shadow_moments", &lighting_program::shadow_moments_loc },
+    { "u_evsm_bleed", &lighting_program::evsm_bleed_loc },
 };
 
 } 
 
-lighting_program create_lighting_program() {
-    auto program = lighting_program{};
+std::string lighting_defines(const unsigned features, const int shadow_samples) {
+    auto defines = "#define SHADOW_SAMPLES " + std::to_string(shadow_samples) + "\n";
+    if (features & LIGHTING_DIFFUSE_TEXTURED) defines += "#define DIFFUSE_TEXTURED\n";
+    if (features & LIGHTING_NORMAL_TEXTURED) defines += "#define NORMAL_TEXTURED\n";
+    if (features & LIGHTING_REFLECTIVE) defines += "#define REFLECTIVE\n";
+
+    return defines;
+}
 
-    const std::pair<const char*, GLenum> shaders[] {
+std::vector<std::pair<const char*, GLenum>> lighting_shaders(const unsigned features) {
+    if (features & LIGHTING_SHADOW_MASK) {
+        return {
+            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/shadow_mask_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+    }
+
+    if (features & LIGHTING_LAYERED) {
+        return {
+            { "shaders/lighting_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/lighting_layered_geometry.glsl", GL_GEOMETRY_SHADER },
+            { "shaders/lighting_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+    }
+
+    return {
         { "shaders/lighting_vertex.glsl", GL_VERTEX_SHADER },
         { "shaders/lighting_fragment.glsl", GL_FRAGMENT_SHADER },
     };
+}
 
-    program.id = gl::load_shader_program(shaders);
-    gl::link_shader_program(program.id);
+/* program_id must be linked */
+lighting_program init_lighting_program(const GLuint program_id, const unsigned features) {
+    auto program = lighting_program{};
+    program.id = program_id;
+    program.features = features;
+
+    const auto layered = (features & LIGHTING_LAYERED) != 0;
 
     const auto transf_block_index = glGetUniformBlockIndex(program.id, "transformations");
     glUniformBlockBinding(program.id, transf_block_index, transf_binding_point);
@@ -68,21 +160,18 @@ lighting_program create_lighting_program() {
     glUniformBlockBinding(program.id, lights_block_index, lights_binding_point);
 
     const auto mtl_block_index = glGetUniformBlockIndex(program.id, "material");
-    glUniformBlockBinding(program.id, mtl_block_index, mtl_binding_point);
+    if (mtl_block_index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program.id, mtl_block_index, mtl_binding_point);
+    }
+
+    const auto cube_transf_block_index = glGetUniformBlockIndex(program.id, "cube_transformations");
+    if (cube_transf_block_index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program.id, cube_transf_block_index, cube_transf_binding_point);
+    }
 
     glUseProgram(program.id);
     scope_exit({ glUseProgram(0); });
 
-    for (auto i = 0; i < MAX_LIGHTS; ++i) {
-        const auto map_name = "u_shadow_maps[" + std::to_string(i) + ']';
-        program.shadow_maps_loc[i] = glGetUniformLocation(program.id, map_name.data());
-
-        const auto matrix_name = "u_shadow_bias_matrices[" + std::to_string(i) + ']';
-        program.shadow_bias_matrices_loc[i] = glGetUniformLocation(program.id, matrix_name.data());
-
-        glUniform1i(program.shadow_maps_loc[i], FIRST_SM_TIU - GL_TEXTURE0 + i);
-    }
-
     for (auto& uniform : lighting_program_uniforms) {
         program.*uniform.ptr = glGetUniformLocation(program.id, uniform.name);
     }
@@ -92,8 +181,28 @@ lighting_program create_lighting_program() {
     glUniform1i(program.height_map_loc, 2);
     glUniform1i(program.occlusion_map_loc, 3);
     glUniform1i(program.reflection_map_loc, 4);
+    glUniform1i(program.diffuse_array_loc, 5);
+    glUniform1i(program.scene_color_loc, 7);
+    glUniform1i(program.normal_depth_map_loc, 8);
+    glUniform1i(program.shadow_mask_loc, 9);
+    glUniform1i(program.cluster_grid_loc, 12);
+    glUniform1i(program.cluster_indices_loc, 13);
+    glUniform1i(program.point_lights_loc, 14);
+    glUniform1i(program.shadow_maps_loc, SM_TIU - GL_TEXTURE0);
+    glUniform1i(program.shadow_moments_loc, SM_MOMENTS_TIU - GL_TEXTURE0);
+    glUniform1i(program.world_matrices_loc, WORLD_MATRICES_TIU - GL_TEXTURE0);
+    glUniform1i(program.layered_loc, layered);
 
     return program;
 }
 
+lighting_program create_lighting_program(const unsigned features, const int shadow_samples) {
+    const auto shaders = lighting_shaders(features);
+    const auto program_id = gl::load_shader_program(shaders.data(), shaders.size(),
+        lighting_defines(features, shadow_samples));
+    gl::link_shader_program(program_id);
+
+    return init_lighting_program(program_id, features);
+}
+
 #endif /* lighting_program_h */
@@ -1,7 +1,12 @@
 #include "scene.h"
+#include "clusters.h"
 #include "opengl_application.h"
 #include "debug_surface.h"
+#include "file_watcher.h"
 #include "gl/util.h"
+#include "gl/uniform_ring.h"
+#include "batch_math.h"
+#include "job_system.h"
 #include "ext.h"
 #include "scope_exit.h"
 #include "ui/slider.h"
@@ -11,14 +16,47 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <algorithm>
+#include <chrono>
 #include <iostream>
-
-const auto SM_WIDTH = 1024;
-const auto SM_HEIGHT = 1024;
-const auto SSAO_MAP_WIDTH = 640;
-const auto SSAO_MAP_HEIGHT = 480;
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <set>
+
+const auto SM_ATLAS_SIZE = 2048;
+const auto SM_ATLAS_PAGES = 2;
+const auto SM_MIN_TILE = 128;
+const auto SM_MAX_TILE = 1024;
+const auto SM_MOMENTS_MAX_LEVEL = 4;
+const auto SM_FILTER_PCF = 0;
+const auto SM_FILTER_EVSM = 1;
+const auto SM_DEFAULT_SAMPLES = 8;
+const auto SSAO_DEFAULT_SCALE = 0.5f;
+const auto SSAO_TILE_SIZE = 16;
+const auto SSAO_PATH_FRAGMENT = 0;
+const auto SSAO_PATH_COMPUTE = 1;
+const auto SSAO_DEFAULT_SAMPLES = 16;
 const auto SPHERE_REFLECTION_MAP_WIDTH = 256;
 const auto SPHERE_REFLECTION_MAP_HEIGHT = 256;
+const auto PROBE_UPDATE_ON_CHANGE = 0;
+const auto PROBE_UPDATE_ROUND_ROBIN = 1;
+const auto PROBE_UPDATE_FIXED_RATE = 2;
+const auto PROBE_RADIUS = 10.0f;
+const auto PROBE_AGE_PRIORITY = 0.25f;
+const auto STRESS_INSTANCES_PER_ROW = 100;
+const auto TRANSFORM_STRESS_MAX_NODES = 100000;
+const auto TRANSFORM_STRESS_GROUP = 1000;
+const auto CASCADE_SPLIT_LAMBDA = 0.75f;
+const auto BENCHMARK_WARMUP_FRAMES = 30;
+const auto BENCHMARK_FRAMES = 120;
+const int BENCHMARK_LIGHT_COUNTS[] { 1, 2, 4, 8, 16, 32 };
+const int BENCHMARK_POINT_LIGHT_COUNTS[] { 0, 128, 256, 512, 1024, 2048, 4096 };
+const auto BENCHMARK_SHADOWS = 0;
+const auto BENCHMARK_CLUSTERS = 1;
+const auto CLUSTERED_DEFAULT_LIGHTS = 256;
+const auto CLUSTERED_LIGHT_RADIUS = 1.0f;
+const auto CLUSTERED_CULL_GRAIN = size_t{1024};
+const auto SCENE_SAMPLES = 4;
 
 const glm::mat4 depth_bias_matrix{
     0.5f,   0,      0,      0,
@@ -35,6 +73,11 @@ struct transformations {
     glm::mat4 normal_matrix;
 };
 
+struct cube_transformations {
+    glm::mat4 view_matrices[6];
+    glm::mat4 mvp_matrices[6];
+};
+
 class handler {
     struct scene scene;
 
@@ -47,37 +90,53 @@ class handler {
         glm::vec3 up{0, 1, 0};
     } camera;
 
-    glm::mat4 model, view;
+    glm::mat4 view;
     transformations transf;
+    bool transf_dirty = false;
 
-    GLuint transf_buffer_id;
-    GLuint lights_buffer_id;
+    gl::uniform_ring uniforms;
+    job_system jobs;
 
+    /* The prepass draws into scene_target.prepass_fbo_id, tex_id gets its first sample at the ssao resolution
+     * and a pyramid keeping the nearest depth of each 2x2. */
     struct {
-        GLuint fbo_id;
-        GLuint renderbuffer_id;
+        GLuint fbo_id, pyramid_fbo_id;
         GLuint tex_id;
-        GLuint program_id;
+        GLuint program_id, resolve_program_id, pyramid_program_id;
+        GLint levels;
 
-        GLuint near_loc;
         GLuint far_loc;
+        GLuint instanced_loc;
+        GLuint node_loc;
+        GLuint resolve_target_size_loc;
     } depth;
 
-    struct {
-        GLuint fbo_id;
-        GLuint renderbuffer_id;
-        GLuint tex_id, blurred_tex_id, noise_tex_id;
-        GLuint program_id, hblur_program_id, vblur_program_id;
+    struct ssao_program {
+        GLuint id;
 
         GLuint noise_map_loc;
         GLuint normal_depth_map_loc;
         GLuint total_strength_loc;
         GLuint strength_loc;
-        GLuint sample_count_loc;
         GLuint offset_loc;
         GLuint falloff_loc;
         GLuint radius_loc;
         GLuint depth_bias_loc;
+        GLuint noise_offset_loc;
+        GLuint mip_sampling_loc;
+    };
+
+    struct {
+        GLuint fbo_id;
+        GLuint renderbuffer_id;
+        GLuint tex_id, blurred_tex_id, noise_tex_id, result_tex_id;
+        GLuint hblur_program_id, vblur_program_id;
+        ssao_program program, compute_program;
+        bool compute_supported;
+        int path;
+        int sample_count;
+        float scale;
+        int width, height;
 
         GLuint hblur_sampler_loc;
         GLuint hblur_size_loc;
@@ -85,28 +144,195 @@ class handler {
         GLuint vblur_size_loc;
     } ssao;
 
+    struct shadow_map_state {
+        glm::mat4 rendered_mvp;
+        glm::vec4 rendered_rect;
+        GLint rendered_page;
+        bool valid;
+        bool statics_changed;
+        bool dynamics_changed;
+    };
+
     struct {
-        GLuint fbo_id;
-        std::vector<GLuint> tex_ids;
+        GLuint fbo_id, static_fbo_id;
+        GLuint layer_read_fbo_id, layer_draw_fbo_id;
+        GLuint moments_fbo_id, moments_read_fbo_id;
+        GLuint tex_id, static_tex_id;
+        GLuint moments_tex_id, moments_blur_tex_id;
+        GLuint depth_sampler_id;
         std::vector<glm::mat4> mvp_matrices;
-        GLuint program_id;
-        bool update_required;
-
-        GLuint depth_mvp_matrix_loc;
+        std::vector<glm::vec4> rects;
+        std::vector<GLint> pages;
+        std::vector<int> tile_limits;
+        std::vector<glm::ivec2> light_views;
+        std::vector<glm::vec4> cascade_splits;
+        std::vector<shadow_map_state> states;
+        GLuint program_id, moments_program_id;
+        int filter;
+        int samples;
+        bool split_static;
+        int cascade_count;
+        int cascade_resolution;
+        int renders;
+
+        GLuint depth_mvp_matrices_loc;
+        GLuint view_rects_loc;
+        GLuint view_pages_loc;
+        GLuint views_loc;
+        GLuint view_count_loc;
+        GLuint instanced_loc;
+        GLuint node_loc;
+
+        GLuint moments_from_depth_loc;
+        GLuint moments_page_loc;
+        GLuint moments_tile_loc;
+        GLuint moments_direction_loc;
+        GLuint moments_blur_radius_loc;
     } sm;
 
-    struct {
+    struct reflection_probe {
+        glm::vec3 pos;
         GLuint fbo_id;
-        GLuint renderbuffer_id;
-        GLuint tex_id;
+        GLuint tex_id, depth_tex_id;
+        int mode;
+        int faces_per_update;
+        float interval;
+        int priority;
+        int frames_waiting;
+        float radius;
+        int dirty_faces;
+        int next_face;
+        float last_update;
+        bool casters_changed;
+        std::vector<light> seen_lights;
+    };
+
+    struct {
+        std::vector<reflection_probe> probes;
+        GLuint face_fbo_id;
+        int face_budget;
+        int faces_rendered;
     } reflection;
 
+    struct {
+        GLuint color_fbo_id;
+        GLuint color_tex_id;
+        glm::mat4 prev_mvp_matrix;
+        bool enabled;
+    } ssr;
+
+    /* The lit scene is rendered multisampled with a known color format and resolved into ssr.color_tex_id,
+     * which then goes to the single sampled default framebuffer. The normal/depth prepass shares its depth,
+     * so lighting only shades the visible surface. */
+    struct {
+        GLuint fbo_id, prepass_fbo_id;
+        GLuint color_renderbuffer_id, depth_renderbuffer_id;
+        GLuint normal_depth_tex_id;
+        GLint samples;
+    } scene_target;
+
+    struct {
+        GLuint grid_buffer_id, index_buffer_id, light_buffer_id;
+        GLuint grid_tex_id, index_tex_id, light_tex_id;
+        clusters::grid grid;
+        std::vector<clusters::point_light> lights_eyespace;
+        std::vector<float> x, y, z, radius;
+        std::vector<uint8_t> visible;
+        double cpu_ms;
+    } clustered;
+
+    /* The stress nodes follow the scene's nodes and are never drawn, they only load the transform update. */
+    struct {
+        GLuint buffer_id, tex_id;
+        int updated;
+        double cpu_ms;
+        bool animate;
+        int stress_nodes, first_stress_node;
+    } world_matrices;
+
+    /* world bounds of scene.objs followed by scene.instanced_objs */
+    struct {
+        std::vector<float> center_x, center_y, center_z;
+        std::vector<float> extent_x, extent_y, extent_z;
+        std::vector<uint8_t> visible;
+    } culling;
+
+    /* enabled shades with GL_EQUAL against the prepass depth instead of clearing it */
+    struct {
+        bool enabled;
+        bool overdraw;
+    } early_z;
+
+    struct {
+        std::unique_ptr<file_watcher> watcher;
+        std::unique_ptr<gl::program_batch> pending;
+    } hot_reload;
+
+    struct temporal_filter {
+        GLuint fbo_id;
+        GLuint history_tex_ids[2];
+        GLenum internal_format;
+        int current;
+        bool history_valid;
+    };
+
+    struct {
+        GLuint program_id;
+        GLuint prev_normal_depth_fbo_id, prev_normal_depth_tex_id;
+        GLuint shadow_mask_fbo_id, shadow_mask_tex_id;
+        glm::mat4 prev_mv_matrix, prev_mvp_matrix;
+        bool enabled;
+        unsigned frame;
+
+        GLuint reprojection_matrix_loc;
+        GLuint normal_reprojection_matrix_loc;
+        GLuint projection_scale_loc;
+        GLuint far_loc;
+        GLuint alpha_loc;
+        GLuint history_valid_loc;
+
+        temporal_filter ssao, shadows;
+    } temporal;
+
+    struct gpu_timer {
+        GLuint query_ids[2][2];
+        unsigned frame;
+        float ms;
+    };
+
+    struct {
+        gpu_timer depth;
+        gpu_timer ssao;
+        gpu_timer blur;
+        gpu_timer ssao_compute;
+        gpu_timer temporal;
+        gpu_timer shadow_mask;
+        gpu_timer pyramid;
+        gpu_timer probes;
+        gpu_timer lighting;
+    } timers;
+
     bool camera_dragging = false;
     glm::vec2 prev_mouse_pos;
 
     glm::vec2 framebuffer_size;
     glm::vec2 window_size;
 
+    float avg_frame_time = 0;
+
+    struct {
+        GLuint query_ids[2];
+        unsigned queries_issued;
+        int step;
+        int frame;
+        double gpu_time;
+        double cpu_time;
+        int kind;
+        std::vector<light> lights;
+        size_t point_light_count;
+        int filter;
+    } benchmark;
+
     debug_surface debug;
 
     struct {
@@ -129,25 +355,67 @@ class handler {
             ui::slider<float>* falloff;
             ui::slider<float>* radius;
             ui::slider<float>* depth_bias;
+            ui::slider<int>* compute;
+            ui::slider<int>* mip_sampling;
+            ui::slider<float>* scale;
             ui::slider<float>* hblur_size;
             ui::slider<float>* vblur_size;
         } ssao;
         struct {
             ui::slider<int>* samples;
             ui::slider<float>* distance;
+            ui::slider<int>* split_static;
+            ui::slider<int>* directional;
+            ui::slider<int>* cascades;
+            ui::slider<int>* cascade_resolution;
+            ui::slider<int>* filter;
+            ui::slider<int>* blur_radius;
+            ui::slider<float>* bleed;
+            ui::slider<int>* benchmark;
         } sm;
         struct {
             ui::slider<float>* scale;
             ui::slider<float>* bias;
         } parallax;
+        struct {
+            ui::slider<int>* mode;
+            ui::slider<int>* faces;
+            ui::slider<float>* rate;
+            ui::slider<int>* budget;
+        } probes;
+        struct {
+            ui::slider<int>* enabled;
+            ui::slider<float>* max_distance;
+            ui::slider<float>* thickness;
+        } ssr;
+        struct {
+            ui::slider<int>* enabled;
+            ui::slider<int>* overdraw;
+        } early_z;
+        struct {
+            ui::slider<int>* count;
+            ui::slider<int>* benchmark;
+        } clustered;
+        struct {
+            ui::slider<int>* enabled;
+            ui::slider<float>* alpha;
+        } temporal;
+        struct {
+            ui::slider<int>* stress;
+        } instancing;
+        struct {
+            ui::slider<int>* animate;
+            ui::slider<int>* stress_nodes;
+        } transforms;
 
         ui::text* fps;
+        ui::text* timings;
     } ui;
 
     void look_at(const glm::vec3& eye, const glm::vec3& center, const glm::vec3& up) {
         view = glm::lookAt(eye, center, up);
-        transf.mv_matrix = view * model;
-        transf.normal_matrix = glm::transpose(glm::inverse(transf.mv_matrix));
+        transf.mv_matrix = view;
+        batch::normal_matrices(&transf.mv_matrix, &transf.normal_matrix, 1);
         transf.mvp_matrix = transf.projection_matrix * transf.mv_matrix;
     }
 
@@ -171,325 +439,1306 @@ class handler {
         camera.eye = glm::vec3(eye);
     }
 
-    void create_transf_ubo() {
-        glGenBuffers(1, &transf_buffer_id);
-        glBindBufferBase(GL_UNIFORM_BUFFER, transf_binding_point, transf_buffer_id);
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(transformations), nullptr, GL_DYNAMIC_DRAW);
+    void create_uniform_ring() {
+        uniforms.create(256 * 1024);
     }
 
     void update_transf_ubo() {
-        glBindBuffer(GL_UNIFORM_BUFFER, transf_buffer_id);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(transformations), &transf);
+        uniforms.write(transf_binding_point, transf);
+        transf_dirty = false;
     }
 
-    void create_lights_ubo() {
-        glGenBuffers(1, &lights_buffer_id);
-        glBindBufferBase(GL_UNIFORM_BUFFER, lights_binding_point, lights_buffer_id);
+    void update_cube_transf_ubo(const glm::vec3& center) {
+        const glm::vec3 directions[][2] {
+            { { 1, 0, 0 },  { 0, -1, 0 } },
+            { { -1, 0, 0 }, { 0, -1, 0 } },
+            { { 0, 1, 0 },  { 0, 0, -1 } },
+            { { 0, -1, 0 }, { 0, 0, -1 } },
+            { { 0, 0, 1 },  { 0, -1, 0 } },
+            { { 0, 0, -1 }, { 0, -1, 0 } },
+        };
 
-        const auto num_lights_offset = MAX_LIGHTS * sizeof(scene.lights.front());
-        const auto num_lights = GLint(scene.lights.size());
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(num_lights) + num_lights_offset, nullptr, GL_DYNAMIC_DRAW);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, scene.lights.size() * sizeof(scene.lights.front()), scene.lights.data());
-        glBufferSubData(GL_UNIFORM_BUFFER, num_lights_offset, sizeof(num_lights), &num_lights);
+        const auto projection = glm::perspective(glm::radians(90.0f),
+            static_cast<float>(SPHERE_REFLECTION_MAP_WIDTH) / SPHERE_REFLECTION_MAP_HEIGHT, 0.1f, 50.0f);
+
+        auto cube_transf = cube_transformations{};
+        for (auto face = 0; face < 6; ++face) {
+            cube_transf.view_matrices[face] =
+                glm::lookAt(center, center + directions[face][0], directions[face][1]);
+            cube_transf.mvp_matrices[face] = projection * cube_transf.view_matrices[face];
+        }
+
+        uniforms.write(cube_transf_binding_point, cube_transf);
     }
 
     void update_lights_ubo() {
-        glBindBuffer(GL_UNIFORM_BUFFER, lights_buffer_id);
-
         const auto num_lights_offset = MAX_LIGHTS * sizeof(scene.lights.front());
         const auto num_lights = GLint(scene.lights.size());
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, scene.lights.size() * sizeof(scene.lights.front()), scene.lights.data());
-        glBufferSubData(GL_UNIFORM_BUFFER, num_lights_offset, sizeof(num_lights), &num_lights);
+
+        uniforms.write(lights_binding_point, num_lights_offset + sizeof(num_lights), [&] (char* dst) {
+            std::memcpy(dst, scene.lights.data(), scene.lights.size() * sizeof(scene.lights.front()));
+            std::memcpy(dst + num_lights_offset, &num_lights, sizeof(num_lights));
+        });
     }
 
     void create_shadow_maps() {
-        sm.tex_ids = std::vector<GLuint>(scene.lights.size());
-        glGenTextures(scene.lights.size(), &sm.tex_ids[0]);
+        if (scene.lights.size() > MAX_LIGHTS) throw std::runtime_error{"too many lights"};
+
+        sm.cascade_count = 3;
+        sm.cascade_resolution = SM_MAX_TILE / 2;
+        sm.filter = SM_FILTER_PCF;
+
+        glGenTextures(1, &sm.tex_id);
+        glGenTextures(1, &sm.static_tex_id);
+
+        sm.states = std::vector<shadow_map_state>(MAX_SHADOW_VIEWS);
 
         scope_exit({ glActiveTexture(GL_TEXTURE0); });
 
-        GLfloat border_color[] { 1.0f, 0, 0, 0 };
-        for (size_t i = 0; i < scene.lights.size(); ++i) {
-            glActiveTexture(FIRST_SM_TIU + i);
-            glBindTexture(GL_TEXTURE_2D, sm.tex_ids[i]);
+        const auto init_depth_texture = [] (const GLuint tex_id) {
+            const GLfloat border_color[] { 1.0f, 0, 0, 0 };
 
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, SM_WIDTH, SM_HEIGHT,
+            glBindTexture(GL_TEXTURE_2D_ARRAY, tex_id);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT16, SM_ATLAS_SIZE, SM_ATLAS_SIZE, SM_ATLAS_PAGES,
                 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-            glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_color);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_color);
+        };
+
+        glActiveTexture(GL_TEXTURE0);
+        init_depth_texture(sm.static_tex_id);
+
+        glActiveTexture(SM_TIU);
+        init_depth_texture(sm.tex_id);
+
+        glGenTextures(1, &sm.moments_tex_id);
+        glActiveTexture(SM_MOMENTS_TIU);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, sm.moments_tex_id);
+        for (auto level = 0; level <= SM_MOMENTS_MAX_LEVEL; ++level) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA16F, SM_ATLAS_SIZE >> level, SM_ATLAS_SIZE >> level,
+                SM_ATLAS_PAGES, 0, GL_RGBA, GL_FLOAT, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, SM_MOMENTS_MAX_LEVEL);
+
+        glGenTextures(1, &sm.moments_blur_tex_id);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sm.moments_blur_tex_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SM_ATLAS_SIZE, SM_ATLAS_SIZE, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        glGenSamplers(1, &sm.depth_sampler_id);
+        glSamplerParameteri(sm.depth_sampler_id, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glSamplerParameteri(sm.depth_sampler_id, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glSamplerParameteri(sm.depth_sampler_id, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+        const std::pair<GLuint, GLuint> layered_fbos[] {
+            { sm.fbo_id, sm.tex_id },
+            { sm.static_fbo_id, sm.static_tex_id },
+        };
+
+        for (auto& fbo : layered_fbos) {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo.first);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, fbo.second, 0);
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                throw std::runtime_error{"create_shadow_maps() failed"};
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sm.moments_fbo_id);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sm.moments_tex_id, 0, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error{"create_shadow_maps() failed"};
         }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
         calculate_shadow_mvps();
     }
 
+    /* Only the cached views and the probes the caster's bounds overlap are re-rendered, call it with the bounds
+     * before and after a change. */
+    void invalidate_casters(const glm::vec3& bounds_min, const glm::vec3& bounds_max, const bool dynamic) {
+        for (auto& probe : reflection.probes) {
+            const auto nearest = glm::clamp(probe.pos, bounds_min, bounds_max);
+            if (glm::distance(nearest, probe.pos) <= probe.radius) probe.casters_changed = true;
+        }
+
+        const auto center = (bounds_min + bounds_max) / 2.0f;
+        const auto extent = (bounds_max - bounds_min) / 2.0f;
+
+        for (auto& state : sm.states) {
+            if (!state.valid) continue;
+
+            auto overlaps = uint8_t{};
+            batch::cull_aabbs(batch::extract_frustum(state.rendered_mvp), &center.x, &center.y, &center.z,
+                &extent.x, &extent.y, &extent.z, 1, &overlaps);
+            if (!overlaps) continue;
+
+            if (dynamic) state.dynamics_changed = true;
+            else state.statics_changed = true;
+        }
+    }
+
+    template<typename object>
+    void invalidate_caster(const object& obj) {
+        invalidate_casters(obj.bounds_min, obj.bounds_max, obj.dynamic);
+    }
+
+    void invalidate_shadow_maps() {
+        for (auto& state : sm.states) state.valid = false;
+    }
+
     void calculate_shadow_mvps() {
         sm.mvp_matrices = {};
+        sm.tile_limits = {};
+        sm.light_views = {};
+        sm.cascade_splits = {};
 
-        const auto aspect_ratio = static_cast<float>(SM_WIDTH) / SM_HEIGHT;
-        std::transform(std::begin(scene.lights), std::end(scene.lights), std::back_inserter(sm.mvp_matrices),
-            [=] (const light& l) {
-                return glm::perspective(glm::radians(45.0f), aspect_ratio, 1.0f, 100.0f) *
-                    glm::lookAt(glm::vec3(l.pos), camera.center, camera.up);
+        for (size_t i = 0; i < scene.lights.size(); ++i) {
+            const auto& l = scene.lights[i];
+            const auto first_view = static_cast<int>(sm.mvp_matrices.size());
+            const auto views_left = MAX_SHADOW_VIEWS - first_view - static_cast<int>(scene.lights.size() - i - 1);
+
+            if (l.pos.w == 0 && views_left >= sm.cascade_count) {
+                calculate_cascades(l);
+            } else if (views_left > 0) {
+                const auto eye = l.pos.w == 0 ? camera.center + 50.0f * glm::normalize(glm::vec3(l.pos)) : glm::vec3(l.pos);
+
+                sm.mvp_matrices.push_back(glm::perspective(glm::radians(45.0f), 1.0f, 1.0f, 100.0f) *
+                    glm::lookAt(eye, camera.center, camera.up));
+                sm.tile_limits.push_back(SM_MAX_TILE);
+                sm.cascade_splits.push_back(glm::vec4(camera.far));
+            } else {
+                sm.cascade_splits.push_back(glm::vec4(camera.far));
             }
-        );
+
+            sm.light_views.push_back({ first_view, static_cast<int>(sm.mvp_matrices.size()) - first_view });
+        }
+
+        pack_shadow_atlas();
     }
 
-    void create_scene() {
-        scene.program = create_lighting_program();
+    void calculate_cascades(const light& l) {
+        const auto dir = glm::normalize(glm::vec3(l.pos));
+        const auto camera_view = glm::lookAt(camera.eye, camera.center, camera.up);
+        const auto inv_camera_view = glm::inverse(camera_view);
+        const auto aspect = framebuffer_size.x / framebuffer_size.y;
+        const auto tan_half_fovy = std::tan(glm::radians(camera.fovy) / 2);
+
+        const glm::vec3 bounds_corners[] {
+            { scene.bounds_min.x, scene.bounds_min.y, scene.bounds_min.z },
+            { scene.bounds_max.x, scene.bounds_min.y, scene.bounds_min.z },
+            { scene.bounds_min.x, scene.bounds_max.y, scene.bounds_min.z },
+            { scene.bounds_max.x, scene.bounds_max.y, scene.bounds_min.z },
+            { scene.bounds_min.x, scene.bounds_min.y, scene.bounds_max.z },
+            { scene.bounds_max.x, scene.bounds_min.y, scene.bounds_max.z },
+            { scene.bounds_min.x, scene.bounds_max.y, scene.bounds_max.z },
+            { scene.bounds_max.x, scene.bounds_max.y, scene.bounds_max.z },
+        };
 
-        scene.objs.reserve(2);
-        scene.objs.push_back(create_ball());
-        scene.objs.push_back(create_plane());
+        const auto light_up = std::abs(dir.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+        const auto light_view = glm::lookAt(glm::vec3(), -dir, light_up);
 
-		create_skybox();
+        auto min_depth = camera.far, max_depth = camera.near;
+        auto min_z = FLT_MAX, max_z = -FLT_MAX;
+        for (auto& corner : bounds_corners) {
+            const auto depth = -(camera_view * glm::vec4(corner, 1)).z;
+            min_depth = std::min(min_depth, depth);
+            max_depth = std::max(max_depth, depth);
 
-        scene.lights = {
-            { { 20, 15, 10, 1 }, { 0.7f, 0.7f, 0.7f, 1 } },
-            { { 20, 20, -15, 1 }, { 0.7f, 0.7f, 0.7f, 1 } },
-        };
-    }
+            const auto z = (light_view * glm::vec4(corner, 1)).z;
+            min_z = std::min(min_z, z);
+            max_z = std::max(max_z, z);
+        }
 
-	void create_skybox() {
-		scene.skybox.mesh = mesh::gen_skybox();
-		scene.skybox.tex_id = gl::load_png_texture_cube("textures/skybox");
+        const auto near = std::max(camera.near, min_depth);
+        const auto far = std::max(near + 0.1f, std::min(camera.far, max_depth));
 
-		create_skybox_shader();
-	}
+        auto splits = glm::vec4(far);
+        auto slice_near = near;
 
-    void create_depth_fbo() {
-        glGenRenderbuffers(1, &depth.renderbuffer_id);
-        glBindRenderbuffer(GL_RENDERBUFFER, depth.renderbuffer_id);
-        glRenderbufferStorage(
-            GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
-            SSAO_MAP_WIDTH, SSAO_MAP_HEIGHT
-        );
+        for (auto cascade = 0; cascade < sm.cascade_count; ++cascade) {
+            const auto t = static_cast<float>(cascade + 1) / sm.cascade_count;
+            const auto slice_far = glm::mix(near + (far - near) * t, near * std::pow(far / near, t), CASCADE_SPLIT_LAMBDA);
+            splits[cascade] = slice_far;
 
-        glGenTextures(1, &depth.tex_id);
-        glBindTexture(GL_TEXTURE_2D, depth.tex_id);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, SSAO_MAP_WIDTH, SSAO_MAP_HEIGHT,
-            0, GL_RGBA, GL_FLOAT, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glm::vec3 corners[8];
+            auto center = glm::vec3();
+            for (auto corner = 0; corner < 8; ++corner) {
+                const auto depth = corner < 4 ? slice_near : slice_far;
+                const auto x = (corner & 1 ? 1 : -1) * depth * tan_half_fovy * aspect;
+                const auto y = (corner & 2 ? 1 : -1) * depth * tan_half_fovy;
 
-        glGenFramebuffers(1, &depth.fbo_id);
-        glBindFramebuffer(GL_FRAMEBUFFER, depth.fbo_id);
-        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth.renderbuffer_id);
-        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, depth.tex_id, 0);
+                corners[corner] = glm::vec3(inv_camera_view * glm::vec4(x, y, -depth, 1));
+                center += corners[corner] / 8.0f;
+            }
 
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+            auto radius = 0.0f;
+            for (auto& corner : corners) radius = std::max(radius, glm::length(corner - center));
+            radius = std::ceil(radius * 16) / 16;
 
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            throw std::runtime_error{"create_depth_fbo() failed"};
+            // the atlas tile may shrink to SM_MIN_TILE, so snap to its texel grid, which every larger power of two
+            // tile shares. The padding of one texel that covers the snapping is part of the width the texel is
+            // derived from: radius + snap_size with snap_size = 2 * (radius + snap_size) / SM_MIN_TILE
+            radius *= static_cast<float>(SM_MIN_TILE) / (SM_MIN_TILE - 2);
+            const auto snap_size = 2 * radius / SM_MIN_TILE;
+
+            auto center_lightspace = glm::vec3(light_view * glm::vec4(center, 1));
+            center_lightspace.x = std::floor(center_lightspace.x / snap_size) * snap_size;
+            center_lightspace.y = std::floor(center_lightspace.y / snap_size) * snap_size;
+
+            const auto projection = glm::ortho(
+                center_lightspace.x - radius, center_lightspace.x + radius,
+                center_lightspace.y - radius, center_lightspace.y + radius,
+                -max_z - 1.0f, -min_z + 1.0f);
+
+            sm.mvp_matrices.push_back(projection * light_view);
+            sm.tile_limits.push_back(cascade == 0 ? SM_MAX_TILE : sm.cascade_resolution);
+
+            slice_near = slice_far;
         }
+
+        sm.cascade_splits.push_back(splits);
     }
 
-    void create_reflection_fbo() {
-        glGenRenderbuffers(1, &reflection.renderbuffer_id);
-        glBindRenderbuffer(GL_RENDERBUFFER, reflection.renderbuffer_id);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
-            SPHERE_REFLECTION_MAP_WIDTH, SPHERE_REFLECTION_MAP_HEIGHT);
+    float screen_importance(const glm::mat4& shadow_mvp) const {
+        const auto inv_shadow_mvp = glm::inverse(shadow_mvp);
 
-        glGenTextures(1, &reflection.tex_id);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, reflection.tex_id);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        for (auto face = 0; face < 6; ++face) {
-            glTexImage2D(
-                GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8,
-                SPHERE_REFLECTION_MAP_WIDTH, SPHERE_REFLECTION_MAP_HEIGHT,
-                0, GL_RGB, GL_UNSIGNED_BYTE, nullptr
-            );
+        auto lo = glm::vec3(FLT_MAX), hi = glm::vec3(-FLT_MAX);
+        for (auto corner = 0; corner < 8; ++corner) {
+            const auto ndc = glm::vec4(corner & 1 ? 1 : -1, corner & 2 ? 1 : -1, corner & 4 ? 1 : -1, 1);
+            const auto world = inv_shadow_mvp * ndc;
+            lo = glm::min(lo, glm::vec3(world) / world.w);
+            hi = glm::max(hi, glm::vec3(world) / world.w);
         }
 
-        glGenFramebuffers(1, &reflection.fbo_id);
-        glBindFramebuffer(GL_FRAMEBUFFER, reflection.fbo_id);
-        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, reflection.renderbuffer_id);
+        lo = glm::max(lo, scene.bounds_min);
+        hi = glm::min(hi, scene.bounds_max);
+        if (lo.x > hi.x || lo.y > hi.y || lo.z > hi.z) return 0;
 
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        const auto camera_mvp = transf.projection_matrix * glm::lookAt(camera.eye, camera.center, camera.up);
 
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            throw std::runtime_error{"create_reflection_fbo() failed"};
+        auto screen_lo = glm::vec2(1), screen_hi = glm::vec2(-1);
+        for (auto corner = 0; corner < 8; ++corner) {
+            const auto world = glm::vec3(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y, corner & 4 ? hi.z : lo.z);
+            const auto clip = camera_mvp * glm::vec4(world, 1);
+            if (clip.w <= camera.near) return 1;
+
+            screen_lo = glm::min(screen_lo, glm::vec2(clip) / clip.w);
+            screen_hi = glm::max(screen_hi, glm::vec2(clip) / clip.w);
         }
-    }
 
-    void create_shadow_maps_fbo() {
-        glGenFramebuffers(1, &sm.fbo_id);
-        glBindFramebuffer(GL_FRAMEBUFFER, sm.fbo_id);
-        glDrawBuffer(GL_NONE);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        screen_lo = glm::clamp(screen_lo, glm::vec2(-1), glm::vec2(1));
+        screen_hi = glm::clamp(screen_hi, glm::vec2(-1), glm::vec2(1));
+        const auto extent = glm::max(screen_hi - screen_lo, glm::vec2(0));
+
+        return extent.x * extent.y / 4;
     }
 
-    void create_ssao_fbo() {
-        glGenRenderbuffers(1, &ssao.renderbuffer_id);
-        glBindRenderbuffer(GL_RENDERBUFFER, ssao.renderbuffer_id);
-        glRenderbufferStorage(
-            GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
-            SSAO_MAP_WIDTH, SSAO_MAP_HEIGHT
-        );
+    bool try_pack_shadow_atlas(const std::vector<int>& tile_sizes, const std::vector<size_t>& order) {
+        auto page = 0, shelf_x = 0, shelf_y = 0, shelf_height = 0;
 
-        glGenTextures(1, &ssao.tex_id);
-        glBindTexture(GL_TEXTURE_2D, ssao.tex_id);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SSAO_MAP_WIDTH, SSAO_MAP_HEIGHT,
-            0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        for (auto view : order) {
+            const auto size = tile_sizes[view];
 
-        glGenFramebuffers(1, &ssao.fbo_id);
-        glBindFramebuffer(GL_FRAMEBUFFER, ssao.fbo_id);
-        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, reflection.renderbuffer_id);
-        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ssao.tex_id, 0);
+            if (shelf_x + size > SM_ATLAS_SIZE) {
+                shelf_x = 0;
+                shelf_y += shelf_height;
+                shelf_height = 0;
+            }
+            if (shelf_y + size > SM_ATLAS_SIZE) {
+                if (++page == SM_ATLAS_PAGES) return false;
+                shelf_x = shelf_y = shelf_height = 0;
+            }
 
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+            const auto scale = 1.0f / SM_ATLAS_SIZE;
+            sm.rects[view] = { shelf_x * scale, shelf_y * scale, size * scale, size * scale };
+            sm.pages[view] = page;
 
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            throw std::runtime_error{"create_reflection_fbo() failed"};
+            shelf_x += size;
+            shelf_height = std::max(shelf_height, size);
         }
-    }
 
-    void create_skybox_shader() {
-        const std::pair<const char*, GLenum> shaders[] {
-            { "shaders/skybox_vertex.glsl", GL_VERTEX_SHADER },
-            { "shaders/skybox_fragment.glsl", GL_FRAGMENT_SHADER },
-        };
+        return true;
+    }
 
-        const auto program_id = gl::load_shader_program(shaders);
-        gl::link_shader_program(program_id);
-        scene.skybox.program_id = program_id;
+    void pack_shadow_atlas() {
+        const auto view_count = sm.mvp_matrices.size();
+        sm.rects = std::vector<glm::vec4>(view_count);
+        sm.pages = std::vector<GLint>(view_count);
 
-        scene.skybox.map_loc = glGetUniformLocation(program_id, "u_map");
+        auto tile_sizes = std::vector<int>(view_count);
+        for (size_t view = 0; view < view_count; ++view) {
+            const auto wanted = SM_MAX_TILE * std::sqrt(screen_importance(sm.mvp_matrices[view]));
 
-        const auto transf_block_index = glGetUniformBlockIndex(program_id, "transformations");
-        if (transf_block_index != GL_INVALID_INDEX) {
-            glUniformBlockBinding(program_id, transf_block_index, transf_binding_point);
+            auto size = SM_MIN_TILE;
+            while (size * 2 <= std::min<float>(wanted * std::sqrt(2.0f), sm.tile_limits[view])) size *= 2;
+            tile_sizes[view] = size;
         }
 
-        glUseProgram(program_id);
-        scope_exit({ glUseProgram(0); });
-        glUniform1i(scene.skybox.map_loc, 0);
-    }
+        auto order = std::vector<size_t>(view_count);
+        for (size_t view = 0; view < view_count; ++view) order[view] = view;
+        std::stable_sort(std::begin(order), std::end(order), [&] (const size_t lhs, const size_t rhs) {
+            return tile_sizes[lhs] > tile_sizes[rhs];
+        });
 
-    void create_depth_shader() {
-        const std::pair<const char*, GLenum> shaders[] {
-            { "shaders/depth_vertex.glsl", GL_VERTEX_SHADER },
-            { "shaders/depth_fragment.glsl", GL_FRAGMENT_SHADER },
-        };
+        while (!try_pack_shadow_atlas(tile_sizes, order)) {
+            const auto largest = *std::max_element(std::begin(tile_sizes), std::end(tile_sizes));
+            if (largest == SM_MIN_TILE) throw std::runtime_error{"shadow atlas overflow"};
 
-        const auto program_id = gl::load_shader_program(shaders);
-        gl::link_shader_program(program_id);
-        depth.program_id = program_id;
+            for (auto& size : tile_sizes) if (size == largest) size /= 2;
+        }
+    }
 
-        depth.near_loc = glGetUniformLocation(program_id, "u_near");
-        depth.far_loc = glGetUniformLocation(program_id, "u_far");
+    static void expand_bounds(const glm::mat4& model, const mesh::mesh_data& mesh,
+        glm::vec3& bounds_min, glm::vec3& bounds_max) {
 
-        const auto transf_block_index = glGetUniformBlockIndex(program_id, "transformations");
-        if (transf_block_index != GL_INVALID_INDEX) {
-            glUniformBlockBinding(program_id, transf_block_index, transf_binding_point);
-        }
+        const auto center = (mesh.bounds_min + mesh.bounds_max) / 2.0f;
+        const auto extent = (mesh.bounds_max - mesh.bounds_min) / 2.0f;
 
+        const auto world_center = glm::vec3(model * glm::vec4(center, 1));
+        const auto world_extent = glm::vec3(
+            glm::dot(glm::abs(glm::vec3(model[0][0], model[1][0], model[2][0])), extent),
+            glm::dot(glm::abs(glm::vec3(model[0][1], model[1][1], model[2][1])), extent),
+            glm::dot(glm::abs(glm::vec3(model[0][2], model[1][2], model[2][2])), extent));
+
+        bounds_min = glm::min(bounds_min, world_center - world_extent);
+        bounds_max = glm::max(bounds_max, world_center + world_extent);
     }
 
-    void create_ssao_shader() {
-        const std::pair<const char*, GLenum> shaders[] {
-            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
-            { "shaders/occlusion_fragment.glsl", GL_FRAGMENT_SHADER },
-        };
+    void update_scene_bounds() {
+        scene.bounds_min = glm::vec3(FLT_MAX);
+        scene.bounds_max = glm::vec3(-FLT_MAX);
 
-        const auto program_id = gl::load_shader_program(shaders);
-        gl::link_shader_program(program_id);
-        ssao.program_id = program_id;
-
-        ssao.noise_map_loc = glGetUniformLocation(program_id, "u_noise_map");
-        ssao.normal_depth_map_loc = glGetUniformLocation(program_id, "u_normal_depth_map");
-        ssao.total_strength_loc = glGetUniformLocation(program_id, "u_total_strength");
-        ssao.strength_loc = glGetUniformLocation(program_id, "u_strength");
-        ssao.sample_count_loc = glGetUniformLocation(program_id, "u_sample_count");
-        ssao.offset_loc = glGetUniformLocation(program_id, "u_offset");
-        ssao.falloff_loc = glGetUniformLocation(program_id, "u_falloff");
-        ssao.radius_loc = glGetUniformLocation(program_id, "u_radius");
-        ssao.depth_bias_loc = glGetUniformLocation(program_id, "u_depth_bias");
+        for (auto& obj : scene.objs) {
+            obj.bounds_min = glm::vec3(FLT_MAX);
+            obj.bounds_max = glm::vec3(-FLT_MAX);
+            expand_bounds(scene.transforms.world(obj.node), obj.mesh, obj.bounds_min, obj.bounds_max);
 
-        glUseProgram(program_id);
-        scope_exit({ glUseProgram(0); });
-        glUniform1i(ssao.noise_map_loc, 0);
-        glUniform1i(ssao.normal_depth_map_loc , 1);
+            scene.bounds_min = glm::min(scene.bounds_min, obj.bounds_min);
+            scene.bounds_max = glm::max(scene.bounds_max, obj.bounds_max);
+        }
 
-        const auto transf_block_index = glGetUniformBlockIndex(program_id, "transformations");
-        glUniformBlockBinding(program_id, transf_block_index, transf_binding_point);
+        for (auto& obj : scene.instanced_objs) {
+            obj.bounds_min = glm::vec3(FLT_MAX);
+            obj.bounds_max = glm::vec3(-FLT_MAX);
+            for (auto& instance : obj.instances) expand_bounds(instance.model, obj.mesh, obj.bounds_min, obj.bounds_max);
 
-        ssao.noise_tex_id = gl::load_png_texture("textures/noise.png");
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            scene.bounds_min = glm::min(scene.bounds_min, obj.bounds_min);
+            scene.bounds_max = glm::max(scene.bounds_max, obj.bounds_max);
+        }
+    }
 
-        glGenTextures(1, &ssao.blurred_tex_id);
-        glBindTexture(GL_TEXTURE_2D, ssao.blurred_tex_id);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SSAO_MAP_WIDTH, SSAO_MAP_HEIGHT,
-            0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    void create_world_matrices() {
+        world_matrices.updated = 0;
+        world_matrices.cpu_ms = 0;
+        world_matrices.animate = false;
+        world_matrices.stress_nodes = 0;
 
-        const std::pair<const char*, GLenum> horizontal_blur_shaders[] {
-            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
-            { "shaders/horizontal_blur_fragment.glsl", GL_FRAGMENT_SHADER },
-        };
-        ssao.hblur_program_id = gl::load_shader_program(horizontal_blur_shaders);
-        gl::link_shader_program(ssao.hblur_program_id);
+        glGenBuffers(1, &world_matrices.buffer_id);
+        glBindBuffer(GL_TEXTURE_BUFFER, world_matrices.buffer_id);
+        scope_exit({ glBindBuffer(GL_TEXTURE_BUFFER, 0); });
 
-        ssao.hblur_sampler_loc = glGetUniformLocation(ssao.hblur_program_id, "u_sampler");
-        ssao.hblur_size_loc = glGetUniformLocation(ssao.hblur_program_id, "u_size");
+        glGenTextures(1, &world_matrices.tex_id);
+        glActiveTexture(WORLD_MATRICES_TIU);
+        scope_exit({ glActiveTexture(GL_TEXTURE0); });
+        glBindTexture(GL_TEXTURE_BUFFER, world_matrices.tex_id);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, world_matrices.buffer_id);
+    }
 
-        const std::pair<const char*, GLenum> vertical_blur_shaders[] {
-            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
-            { "shaders/vertical_blur_fragment.glsl", GL_FRAGMENT_SHADER },
-        };
-        ssao.vblur_program_id = gl::load_shader_program(vertical_blur_shaders);
-        gl::link_shader_program(ssao.vblur_program_id);
+    /* Every object gets a root node, instances are children of their object's node. */
+    void build_transform_hierarchy() {
+        auto& transforms = scene.transforms;
+        transforms.clear();
+
+        for (auto& obj : scene.objs) obj.node = transforms.add(transform_hierarchy::NO_PARENT);
 
-        ssao.vblur_sampler_loc = glGetUniformLocation(ssao.vblur_program_id, "u_sampler");
-        ssao.vblur_size_loc = glGetUniformLocation(ssao.vblur_program_id, "u_size");
+        for (auto& obj : scene.instanced_objs) {
+            obj.node = transforms.add(transform_hierarchy::NO_PARENT);
+            obj.first_instance_node = transforms.size();
+            for (auto& instance : obj.instances) transforms.add(obj.node, instance.model);
+        }
 
+        world_matrices.first_stress_node = transforms.size();
+        add_transform_stress_nodes();
+        upload_world_matrices();
     }
 
-    void create_sm_shader() {
-        const std::pair<const char*, GLenum> shaders[] {
-            { "shaders/shadow_map_vertex.glsl", GL_VERTEX_SHADER },
-            { "shaders/shadow_map_fragment.glsl", GL_FRAGMENT_SHADER },
-        };
+    /* A root per TRANSFORM_STRESS_GROUP nodes with the rest of the group as its children, so the second level
+     * is wide enough to be split into jobs. */
+    void add_transform_stress_nodes() {
+        auto& transforms = scene.transforms;
+        auto root = transform_hierarchy::NO_PARENT;
 
-        const auto program_id = gl::load_shader_program(shaders);
-        gl::link_shader_program(program_id);
-        sm.program_id = program_id;
+        for (auto i = 0; i < world_matrices.stress_nodes; ++i) {
+            const auto offset = static_cast<float>(i % TRANSFORM_STRESS_GROUP) / TRANSFORM_STRESS_GROUP;
+            if (i % TRANSFORM_STRESS_GROUP == 0) root = transforms.add(transform_hierarchy::NO_PARENT);
+            else transforms.add(root, glm::vec3(offset, 0, 0), glm::angleAxis(offset, glm::vec3(0, 0, 1)));
+        }
+    }
 
-        sm.depth_mvp_matrix_loc = glGetUniformLocation(program_id, "depth_mvp_matrix");
+    void set_transform_stress_nodes(const int count) {
+        world_matrices.stress_nodes = count;
+        scene.transforms.truncate(world_matrices.first_stress_node);
+        add_transform_stress_nodes();
+        upload_world_matrices();
     }
 
-    scene_object create_ball() {
-        const auto mesh = mesh::gen_sphere(0.5f, 32, 32);
+    void upload_world_matrices() {
+        auto& transforms = scene.transforms;
+        transforms.update(jobs);
 
-        const auto diffuse_tex_id = gl::load_png_texture("textures/ball_albedo.png");
+        glBindBuffer(GL_TEXTURE_BUFFER, world_matrices.buffer_id);
+        glBufferData(GL_TEXTURE_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.world_matrices().data(),
+            GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
 
-        const auto mtl = material{ { 0, 0, 0, 1 }, { 1, 1, 1, 1 }, 200, 0.15f };
+    /* The instanced objects orbit the origin and every stress root spins, which moves all of their children. */
+    void animate_transforms(const float now) {
+        auto& transforms = scene.transforms;
 
-        auto mtl_buffer_id = GLuint{};
-        glGenBuffers(1, &mtl_buffer_id);
-        glBindBuffer(GL_UNIFORM_BUFFER, mtl_buffer_id);
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(mtl), &mtl, GL_DYNAMIC_DRAW);
+        if (world_matrices.animate) {
+            for (auto& obj : scene.instanced_objs) {
+                transforms.set_rotation(obj.node, glm::angleAxis(0.2f * now, glm::vec3(0, 1, 0)));
+            }
+        }
 
-        return { mesh, mtl, mtl_buffer_id, diffuse_tex_id };
+        for (auto node = world_matrices.first_stress_node; node < transforms.size(); node += TRANSFORM_STRESS_GROUP) {
+            transforms.set_rotation(node, glm::angleAxis(now + node, glm::vec3(0, 1, 0)));
+        }
     }
 
-    scene_object create_plane() {
+    void update_transforms() {
+        const auto start = std::chrono::high_resolution_clock::now();
+        const auto changed = scene.transforms.update(jobs);
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        world_matrices.cpu_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        world_matrices.updated = changed.second - changed.first;
+        if (changed.first == changed.second) return;
+
+        const auto& worlds = scene.transforms.world_matrices();
+        glBindBuffer(GL_TEXTURE_BUFFER, world_matrices.buffer_id);
+        glBufferSubData(GL_TEXTURE_BUFFER, changed.first * sizeof(glm::mat4),
+            (changed.second - changed.first) * sizeof(glm::mat4), &worlds[changed.first]);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        auto moved_objs = std::vector<const scene_object*>{};
+        auto moved_instanced_objs = std::vector<const instanced_object*>{};
+
+        for (auto& obj : scene.objs) {
+            if (obj.node < changed.first || obj.node >= changed.second) continue;
+
+            invalidate_caster(obj);
+            moved_objs.push_back(&obj);
+        }
+
+        /* instanced draws read the matrices from the instance buffer, so the changed ones are copied there */
+        for (auto& obj : scene.instanced_objs) {
+            const auto first = std::max(obj.first_instance_node, changed.first);
+            const auto last = std::min(obj.first_instance_node + static_cast<int>(obj.instances.size()), changed.second);
+            if (first >= last) continue;
+
+            for (auto node = first; node < last; ++node) {
+                obj.instances[node - obj.first_instance_node].model = worlds[node];
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, obj.instance_buffer_id);
+            glBufferSubData(GL_ARRAY_BUFFER, (first - obj.first_instance_node) * sizeof(obj.instances.front()),
+                (last - first) * sizeof(obj.instances.front()), &obj.instances[first - obj.first_instance_node]);
+
+            invalidate_caster(obj);
+            moved_instanced_objs.push_back(&obj);
+        }
+
+        update_scene_bounds();
+        for (auto obj : moved_objs) invalidate_caster(*obj);
+        for (auto obj : moved_instanced_objs) invalidate_caster(*obj);
+    }
+
+    void update_visibility() {
+        auto& c = culling;
+        c.center_x.clear();
+        c.center_y.clear();
+        c.center_z.clear();
+        c.extent_x.clear();
+        c.extent_y.clear();
+        c.extent_z.clear();
+
+        const auto add_bounds = [&c] (const glm::vec3& bounds_min, const glm::vec3& bounds_max) {
+            const auto center = (bounds_min + bounds_max) / 2.0f;
+            const auto extent = (bounds_max - bounds_min) / 2.0f;
+            c.center_x.push_back(center.x);
+            c.center_y.push_back(center.y);
+            c.center_z.push_back(center.z);
+            c.extent_x.push_back(extent.x);
+            c.extent_y.push_back(extent.y);
+            c.extent_z.push_back(extent.z);
+        };
+
+        for (auto& obj : scene.objs) add_bounds(obj.bounds_min, obj.bounds_max);
+        for (auto& obj : scene.instanced_objs) add_bounds(obj.bounds_min, obj.bounds_max);
+
+        c.visible.resize(c.center_x.size());
+        batch::cull_aabbs(batch::extract_frustum(transf.mvp_matrix), c.center_x.data(), c.center_y.data(),
+            c.center_z.data(), c.extent_x.data(), c.extent_y.data(), c.extent_z.data(), c.visible.size(),
+            c.visible.data());
+
+        auto i = size_t{};
+        for (auto& obj : scene.objs) obj.visible = c.visible[i++] != 0;
+        for (auto& obj : scene.instanced_objs) obj.visible = c.visible[i++] != 0;
+    }
+
+    void create_scene(gl::program_batch& programs) {
+        sm.samples = SM_DEFAULT_SAMPLES;
+
+        scene.objs.reserve(2);
+        scene.objs.push_back(create_ball());
+        scene.objs.push_back(create_plane());
+
+        scene.instanced_objs.reserve(1);
+        scene.instanced_objs.push_back(create_instanced_balls());
+
+        create_lighting_variants(programs);
+
+		create_skybox();
+
+        create_world_matrices();
+        build_transform_hierarchy();
+
+        scene.lights = {
+            { { 20, 15, 10, 1 }, { 0.7f, 0.7f, 0.7f, 1 } },
+            { { 20, 20, -15, 1 }, { 0.7f, 0.7f, 0.7f, 1 } },
+        };
+
+        update_scene_bounds();
+    }
+
+	void create_skybox() {
+		scene.skybox.mesh = mesh::gen_skybox();
+		scene.skybox.tex_id = gl::load_png_texture_cube("textures/skybox");
+	}
+
+    void create_depth_fbo() {
+        glGenTextures(1, &depth.tex_id);
+        glBindTexture(GL_TEXTURE_2D, depth.tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &depth.fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, depth.fbo_id);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+        glGenFramebuffers(1, &depth.pyramid_fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, depth.pyramid_fbo_id);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void create_pyramid_shader(gl::program_batch& programs) {
+        const std::pair<const char*, GLenum> shaders[] {
+            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/depth_pyramid_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+
+        programs.add(shaders, [this] (const GLuint program_id) {
+            depth.pyramid_program_id = program_id;
+
+            glUseProgram(program_id);
+            scope_exit({ glUseProgram(0); });
+            glUniform1i(glGetUniformLocation(program_id, "u_normal_depth_map"), 0);
+        }, std::string{}, depth.pyramid_program_id);
+
+        const std::pair<const char*, GLenum> resolve_shaders[] {
+            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/depth_resolve_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+
+        programs.add(resolve_shaders, [this] (const GLuint program_id) {
+            depth.resolve_program_id = program_id;
+            depth.resolve_target_size_loc = glGetUniformLocation(program_id, "u_target_size");
+
+            glUseProgram(program_id);
+            scope_exit({ glUseProgram(0); });
+            glUniform1i(glGetUniformLocation(program_id, "u_normal_depth_map"), 0);
+        }, std::string{}, depth.resolve_program_id);
+    }
+
+    void add_reflection_probe(const glm::vec3& pos, const int priority) {
+        auto probe = reflection_probe{};
+        probe.pos = pos;
+        probe.mode = PROBE_UPDATE_ON_CHANGE;
+        probe.faces_per_update = 6;
+        probe.interval = 0.1f;
+        probe.priority = priority;
+        probe.frames_waiting = 0;
+        probe.radius = PROBE_RADIUS;
+        probe.dirty_faces = 0x3f;
+
+        glGenTextures(1, &probe.depth_tex_id);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, probe.depth_tex_id);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        for (auto face = 0; face < 6; ++face) {
+            glTexImage2D(
+                GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24,
+                SPHERE_REFLECTION_MAP_WIDTH, SPHERE_REFLECTION_MAP_HEIGHT,
+                0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr
+            );
+        }
+
+        glGenTextures(1, &probe.tex_id);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, probe.tex_id);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        for (auto face = 0; face < 6; ++face) {
+            glTexImage2D(
+                GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8,
+                SPHERE_REFLECTION_MAP_WIDTH, SPHERE_REFLECTION_MAP_HEIGHT,
+                0, GL_RGB, GL_UNSIGNED_BYTE, nullptr
+            );
+        }
+
+        glGenFramebuffers(1, &probe.fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, probe.fbo_id);
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, probe.depth_tex_id, 0);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, probe.tex_id, 0);
+
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error{"add_reflection_probe() failed"};
+        }
+
+        reflection.probes.push_back(probe);
+    }
+
+    void create_reflection_probes() {
+        reflection.face_budget = 12;
+        reflection.faces_rendered = 0;
+
+        glGenFramebuffers(1, &reflection.face_fbo_id);
+
+        for (auto& obj : scene.objs) {
+            if (obj.mtl.reflectance > 0) add_reflection_probe((obj.bounds_min + obj.bounds_max) / 2.0f, 1);
+        }
+    }
+
+    void create_ssr() {
+        ssr.enabled = false;
+
+        scope_exit({ glActiveTexture(GL_TEXTURE0); });
+
+        glGenTextures(1, &ssr.color_tex_id);
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, ssr.color_tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &ssr.color_fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, ssr.color_fbo_id);
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    void create_temporal_filter(temporal_filter& filter, const GLenum internal_format) {
+        filter.internal_format = internal_format;
+        filter.current = 0;
+        filter.history_valid = false;
+
+        glGenTextures(2, filter.history_tex_ids);
+        for (const auto tex_id : filter.history_tex_ids) {
+            glBindTexture(GL_TEXTURE_2D, tex_id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+
+        glGenFramebuffers(1, &filter.fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, filter.fbo_id);
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    void create_temporal() {
+        temporal.enabled = false;
+        temporal.frame = 0;
+
+        /* 8 bit history rounds small per-frame changes away at low alpha and stops converging */
+        create_temporal_filter(temporal.ssao, GL_R16F);
+        create_temporal_filter(temporal.shadows, GL_RGBA16F);
+
+        /* the packed normal/depth history must not be filtered */
+        for (const auto tex_id : { &temporal.prev_normal_depth_tex_id, &temporal.shadow_mask_tex_id }) {
+            const GLint filter = tex_id == &temporal.prev_normal_depth_tex_id ? GL_NEAREST : GL_LINEAR;
+            glGenTextures(1, tex_id);
+            glBindTexture(GL_TEXTURE_2D, *tex_id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+
+        for (const auto fbo_id : { &temporal.prev_normal_depth_fbo_id, &temporal.shadow_mask_fbo_id }) {
+            glGenFramebuffers(1, fbo_id);
+            glBindFramebuffer(GL_FRAMEBUFFER, *fbo_id);
+            glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void create_temporal_shader(gl::program_batch& programs) {
+        const std::pair<const char*, GLenum> shaders[] {
+            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/temporal_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+
+        programs.add(shaders, [this] (const GLuint program_id) {
+            temporal.program_id = program_id;
+
+            temporal.reprojection_matrix_loc = glGetUniformLocation(program_id, "u_reprojection_matrix");
+            temporal.normal_reprojection_matrix_loc = glGetUniformLocation(program_id, "u_normal_reprojection_matrix");
+            temporal.projection_scale_loc = glGetUniformLocation(program_id, "u_projection_scale");
+            temporal.far_loc = glGetUniformLocation(program_id, "u_far");
+            temporal.alpha_loc = glGetUniformLocation(program_id, "u_alpha");
+            temporal.history_valid_loc = glGetUniformLocation(program_id, "u_history_valid");
+
+            glUseProgram(program_id);
+            scope_exit({ glUseProgram(0); });
+            glUniform1i(glGetUniformLocation(program_id, "u_current"), 0);
+            glUniform1i(glGetUniformLocation(program_id, "u_history"), 1);
+            glUniform1i(glGetUniformLocation(program_id, "u_normal_depth_map"), 2);
+            glUniform1i(glGetUniformLocation(program_id, "u_prev_normal_depth_map"), 3);
+        }, std::string{}, temporal.program_id);
+    }
+
+    void resize_temporal() {
+        for (const auto filter : { &temporal.ssao, &temporal.shadows }) {
+            for (const auto tex_id : filter->history_tex_ids) {
+                glBindTexture(GL_TEXTURE_2D, tex_id);
+                glTexImage2D(GL_TEXTURE_2D, 0, filter->internal_format, ssao.width, ssao.height,
+                    0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+            }
+            filter->history_valid = false;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, temporal.prev_normal_depth_tex_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, ssao.width, ssao.height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        glBindTexture(GL_TEXTURE_2D, temporal.shadow_mask_tex_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, ssao.width, ssao.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, temporal.prev_normal_depth_fbo_id);
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, temporal.prev_normal_depth_tex_id, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, temporal.shadow_mask_fbo_id);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, temporal.shadow_mask_tex_id, 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error{"resize_temporal() failed"};
+        }
+    }
+
+    void set_temporal(const bool enabled) {
+        temporal.enabled = enabled;
+        temporal.ssao.history_valid = false;
+        temporal.shadows.history_valid = false;
+
+        for_each_screen_lighting_program([enabled] (const lighting_program& program) {
+            glUniform1i(program.shadow_mask_enabled_loc, enabled);
+            if (!enabled) glUniform2f(program.shadow_rotation_loc, 1, 0);
+        });
+
+        for_each_ssao_program([] (const ssao_program& program) {
+            glUniform2f(program.noise_offset_loc, 0, 0);
+        });
+    }
+
+    void create_scene_target() {
+        auto max_samples = GLint{}, max_color_texture_samples = GLint{};
+        glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+        glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &max_color_texture_samples);
+        scene_target.samples = std::min({ SCENE_SAMPLES, static_cast<int>(max_samples),
+            static_cast<int>(max_color_texture_samples) });
+
+        glGenRenderbuffers(1, &scene_target.color_renderbuffer_id);
+        glGenRenderbuffers(1, &scene_target.depth_renderbuffer_id);
+        glGenTextures(1, &scene_target.normal_depth_tex_id);
+
+        glGenFramebuffers(1, &scene_target.fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, scene_target.fbo_id);
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+        glGenFramebuffers(1, &scene_target.prepass_fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, scene_target.prepass_fbo_id);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+        early_z.enabled = true;
+        early_z.overdraw = false;
+    }
+
+    void resize_scene_target(const int width, const int height) {
+        glBindRenderbuffer(GL_RENDERBUFFER, scene_target.color_renderbuffer_id);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, scene_target.samples, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, scene_target.depth_renderbuffer_id);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, scene_target.samples, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        /* fixed sample locations, as attaching it next to a renderbuffer requires */
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, scene_target.normal_depth_tex_id);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, scene_target.samples, GL_RGBA16F, width, height, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+        const auto attach = [this] (const GLuint fbo_id, const GLenum color_target, const GLuint color_id) {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo_id);
+            if (color_target == GL_RENDERBUFFER) {
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_id);
+            } else {
+                glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_id, 0);
+            }
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                scene_target.depth_renderbuffer_id);
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                throw std::runtime_error{"resize_scene_target() failed"};
+            }
+        };
+
+        attach(scene_target.fbo_id, GL_RENDERBUFFER, scene_target.color_renderbuffer_id);
+        attach(scene_target.prepass_fbo_id, GL_TEXTURE_2D_MULTISAMPLE, scene_target.normal_depth_tex_id);
+    }
+
+    void resize_ssr_color(const int width, const int height) {
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, ssr.color_tex_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, ssr.color_fbo_id);
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ssr.color_tex_id, 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error{"resize_ssr_color() failed"};
+        }
+    }
+
+    void set_reflection_mode(const int mode) {
+        ssr.enabled = mode == REFLECTION_SSR;
+
+        for (auto& obj : scene.objs) {
+            if (obj.mtl.reflectance == 0) continue;
+
+            obj.mtl.reflection_mode = mode;
+            glBindBuffer(GL_UNIFORM_BUFFER, obj.mtl_buffer_id);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(obj.mtl), &obj.mtl);
+        }
+    }
+
+    void create_gpu_timer(gpu_timer& timer) {
+        glGenQueries(4, &timer.query_ids[0][0]);
+        timer.frame = 0;
+        timer.ms = 0;
+    }
+
+    void begin_gpu_timer(gpu_timer& timer) {
+        glQueryCounter(timer.query_ids[timer.frame % 2][0], GL_TIMESTAMP);
+    }
+
+    void end_gpu_timer(gpu_timer& timer) {
+        glQueryCounter(timer.query_ids[timer.frame % 2][1], GL_TIMESTAMP);
+        if (++timer.frame < 2) return;
+
+        const auto& previous = timer.query_ids[timer.frame % 2];
+        auto available = GLint{};
+        glGetQueryObjectiv(previous[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return;
+
+        auto begin = GLuint64{}, end = GLuint64{};
+        glGetQueryObjectui64v(previous[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(previous[1], GL_QUERY_RESULT, &end);
+        timer.ms = 0.95f * timer.ms + 0.05f * (end - begin) / 1e6f;
+    }
+
+    void create_shadow_maps_fbo() {
+        glGenFramebuffers(1, &sm.fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, sm.fbo_id);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        glGenFramebuffers(1, &sm.static_fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, sm.static_fbo_id);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        glGenFramebuffers(1, &sm.layer_read_fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, sm.layer_read_fbo_id);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        glGenFramebuffers(1, &sm.layer_draw_fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, sm.layer_draw_fbo_id);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        glGenFramebuffers(1, &sm.moments_fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, sm.moments_fbo_id);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+        glGenFramebuffers(1, &sm.moments_read_fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, sm.moments_read_fbo_id);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void create_ssao_fbo() {
+        ssao.scale = SSAO_DEFAULT_SCALE;
+
+        glGenRenderbuffers(1, &ssao.renderbuffer_id);
+
+        glGenTextures(1, &ssao.tex_id);
+        glBindTexture(GL_TEXTURE_2D, ssao.tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenTextures(1, &ssao.blurred_tex_id);
+        glBindTexture(GL_TEXTURE_2D, ssao.blurred_tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &ssao.fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, ssao.fbo_id);
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    void resize_ssao() {
+        ssao.width = std::max(static_cast<int>(framebuffer_size.x * ssao.scale), 1);
+        ssao.height = std::max(static_cast<int>(framebuffer_size.y * ssao.scale), 1);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, ssao.renderbuffer_id);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, ssao.width, ssao.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        depth.levels = 1 + static_cast<GLint>(std::log2(std::max(ssao.width, ssao.height)));
+
+        glBindTexture(GL_TEXTURE_2D, depth.tex_id);
+        for (auto level = 0; level < depth.levels; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA16F,
+                std::max(ssao.width >> level, 1), std::max(ssao.height >> level, 1),
+                0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, depth.levels - 1);
+
+        for (const auto tex_id : { ssao.tex_id, ssao.blurred_tex_id }) {
+            glBindTexture(GL_TEXTURE_2D, tex_id);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ssao.width, ssao.height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        }
+
+        const auto attach = [] (const GLuint fbo_id, const GLuint renderbuffer_id, const GLuint tex_id) {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo_id);
+            scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffer_id);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex_id, 0);
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                throw std::runtime_error{"resize_ssao() failed"};
+            }
+        };
+
+        attach(depth.fbo_id, 0, depth.tex_id);
+        attach(ssao.fbo_id, ssao.renderbuffer_id, ssao.tex_id);
+
+        resize_temporal();
+    }
+
+    void init_skybox_program(const GLuint id, const bool layered) {
+        const auto transf_block_index = glGetUniformBlockIndex(id, "transformations");
+        if (transf_block_index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(id, transf_block_index, transf_binding_point);
+        }
+
+        const auto cube_transf_block_index = glGetUniformBlockIndex(id, "cube_transformations");
+        if (cube_transf_block_index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(id, cube_transf_block_index, cube_transf_binding_point);
+        }
+
+        glUseProgram(id);
+        scope_exit({ glUseProgram(0); });
+        glUniform1i(glGetUniformLocation(id, "u_map"), 0);
+        glUniform1i(glGetUniformLocation(id, "u_layered"), layered);
+    }
+
+    void create_skybox_shader(gl::program_batch& programs) {
+        const std::pair<const char*, GLenum> shaders[] {
+            { "shaders/skybox_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/skybox_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+
+        programs.add(shaders, [this] (const GLuint program_id) {
+            scene.skybox.program_id = program_id;
+            scene.skybox.map_loc = glGetUniformLocation(program_id, "u_map");
+            init_skybox_program(program_id, false);
+        }, std::string{}, scene.skybox.program_id);
+
+        const std::pair<const char*, GLenum> layered_shaders[] {
+            { "shaders/skybox_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/skybox_layered_geometry.glsl", GL_GEOMETRY_SHADER },
+            { "shaders/skybox_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+
+        programs.add(layered_shaders, [this] (const GLuint program_id) {
+            scene.skybox.layered_program_id = program_id;
+            scene.skybox.faces_loc = glGetUniformLocation(program_id, "u_faces");
+            init_skybox_program(program_id, true);
+        }, std::string{}, scene.skybox.layered_program_id);
+    }
+
+    void create_depth_shader(gl::program_batch& programs) {
+        /* the lighting vertex shader computes gl_Position the same way, so lighting can test GL_EQUAL */
+        const std::pair<const char*, GLenum> shaders[] {
+            { "shaders/lighting_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/depth_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+
+        programs.add(shaders, [this] (const GLuint program_id) {
+            depth.program_id = program_id;
+
+            depth.far_loc = glGetUniformLocation(program_id, "u_far");
+            depth.instanced_loc = glGetUniformLocation(program_id, "u_instanced");
+            depth.node_loc = glGetUniformLocation(program_id, "u_node");
+
+            glUseProgram(program_id);
+            scope_exit({ glUseProgram(0); });
+            glUniform1i(glGetUniformLocation(program_id, "u_world_matrices"), WORLD_MATRICES_TIU - GL_TEXTURE0);
+
+            const auto transf_block_index = glGetUniformBlockIndex(program_id, "transformations");
+            if (transf_block_index != GL_INVALID_INDEX) {
+                glUniformBlockBinding(program_id, transf_block_index, transf_binding_point);
+            }
+
+            const auto cube_transf_block_index = glGetUniformBlockIndex(program_id, "cube_transformations");
+            if (cube_transf_block_index != GL_INVALID_INDEX) {
+                glUniformBlockBinding(program_id, cube_transf_block_index, cube_transf_binding_point);
+            }
+        }, std::string{}, depth.program_id);
+    }
+
+    ssao_program create_ssao_program(const GLuint program_id) {
+        auto program = ssao_program{};
+        program.id = program_id;
+
+        program.noise_map_loc = glGetUniformLocation(program_id, "u_noise_map");
+        program.normal_depth_map_loc = glGetUniformLocation(program_id, "u_normal_depth_map");
+        program.total_strength_loc = glGetUniformLocation(program_id, "u_total_strength");
+        program.strength_loc = glGetUniformLocation(program_id, "u_strength");
+        program.offset_loc = glGetUniformLocation(program_id, "u_offset");
+        program.falloff_loc = glGetUniformLocation(program_id, "u_falloff");
+        program.radius_loc = glGetUniformLocation(program_id, "u_radius");
+        program.depth_bias_loc = glGetUniformLocation(program_id, "u_depth_bias");
+        program.noise_offset_loc = glGetUniformLocation(program_id, "u_noise_offset");
+        program.mip_sampling_loc = glGetUniformLocation(program_id, "u_mip_sampling");
+
+        glUseProgram(program_id);
+        scope_exit({ glUseProgram(0); });
+        glUniform1i(program.noise_map_loc, 0);
+        glUniform1i(program.normal_depth_map_loc , 1);
+
+        return program;
+    }
+
+    template<typename Function>
+    void for_each_ssao_program(Function&& fn) {
+        scope_exit({ glUseProgram(0); });
+
+        glUseProgram(ssao.program.id);
+        fn(ssao.program);
+
+        if (ssao.compute_supported) {
+            glUseProgram(ssao.compute_program.id);
+            fn(ssao.compute_program);
+        }
+    }
+
+    std::vector<std::pair<const char*, GLenum>> ssao_shaders(const bool compute) {
+        if (compute) return { { "shaders/occlusion_compute.glsl", GL_COMPUTE_SHADER } };
+
+        return {
+            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/occlusion_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+    }
+
+    std::string ssao_defines() {
+        return "#define SAMPLE_COUNT " + std::to_string(ssao.sample_count) + "\n";
+    }
+
+    ssao_program load_ssao_program(const bool compute) {
+        const auto shaders = ssao_shaders(compute);
+        const auto program_id = gl::load_shader_program(shaders.data(), shaders.size(), ssao_defines());
+        gl::link_shader_program(program_id);
+
+        return create_ssao_program(program_id);
+    }
+
+    void set_ssao_sample_count(const int sample_count) {
+        if (sample_count == ssao.sample_count) return;
+        finish_hot_reload();
+        ssao.sample_count = sample_count;
+
+        const auto rebuild = [this] (ssao_program& program, const bool compute) {
+            const auto rebuilt = load_ssao_program(compute);
+            gl::copy_uniforms(program.id, rebuilt.id);
+            gl::delete_shader_program(program.id);
+            program = rebuilt;
+        };
+
+        rebuild(ssao.program, false);
+        if (ssao.compute_supported) rebuild(ssao.compute_program, true);
+    }
+
+    void create_ssao_shader(gl::program_batch& programs) {
+        ssao.sample_count = SSAO_DEFAULT_SAMPLES;
+        ssao.path = SSAO_PATH_FRAGMENT;
+        ssao.compute_supported = GLEW_VERSION_4_3;
+
+        add_ssao_programs(programs);
+    }
+
+    void add_ssao_programs(gl::program_batch& programs) {
+        programs.add(ssao_shaders(false), [this] (const GLuint program_id) {
+            ssao.program = create_ssao_program(program_id);
+        }, ssao_defines(), ssao.program.id);
+
+        if (ssao.compute_supported) {
+            programs.add(ssao_shaders(true), [this] (const GLuint program_id) {
+                ssao.compute_program = create_ssao_program(program_id);
+            }, ssao_defines(), ssao.compute_program.id);
+        }
+
+        const std::pair<const char*, GLenum> horizontal_blur_shaders[] {
+            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/horizontal_blur_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+        programs.add(horizontal_blur_shaders, [this] (const GLuint program_id) {
+            ssao.hblur_program_id = program_id;
+            ssao.hblur_sampler_loc = glGetUniformLocation(program_id, "u_sampler");
+            ssao.hblur_size_loc = glGetUniformLocation(program_id, "u_size");
+            init_blur_program(program_id);
+        }, std::string{}, ssao.hblur_program_id);
+
+        const std::pair<const char*, GLenum> vertical_blur_shaders[] {
+            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/vertical_blur_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+        programs.add(vertical_blur_shaders, [this] (const GLuint program_id) {
+            ssao.vblur_program_id = program_id;
+            ssao.vblur_sampler_loc = glGetUniformLocation(program_id, "u_sampler");
+            ssao.vblur_size_loc = glGetUniformLocation(program_id, "u_size");
+            init_blur_program(program_id);
+        }, std::string{}, ssao.vblur_program_id);
+    }
+
+    void init_blur_program(const GLuint program_id) {
+        glUseProgram(program_id);
+        scope_exit({ glUseProgram(0); });
+        glUniform1i(glGetUniformLocation(program_id, "u_normal_depth_map"), 1);
+    }
+
+    void create_ssao_noise() {
+        ssao.noise_tex_id = gl::load_png_texture("textures/noise.png");
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+
+    void create_sm_shader(gl::program_batch& programs) {
+        const std::pair<const char*, GLenum> shaders[] {
+            { "shaders/shadow_map_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/shadow_map_geometry.glsl", GL_GEOMETRY_SHADER },
+            { "shaders/shadow_map_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+
+        programs.add(shaders, [this] (const GLuint program_id) {
+            sm.program_id = program_id;
+
+            sm.depth_mvp_matrices_loc = glGetUniformLocation(program_id, "u_depth_mvp_matrices");
+            sm.view_rects_loc = glGetUniformLocation(program_id, "u_view_rects");
+            sm.view_pages_loc = glGetUniformLocation(program_id, "u_view_pages");
+            sm.views_loc = glGetUniformLocation(program_id, "u_views");
+            sm.view_count_loc = glGetUniformLocation(program_id, "u_view_count");
+            sm.instanced_loc = glGetUniformLocation(program_id, "u_instanced");
+            sm.node_loc = glGetUniformLocation(program_id, "u_node");
+
+            glUseProgram(program_id);
+            scope_exit({ glUseProgram(0); });
+            glUniform1i(glGetUniformLocation(program_id, "u_world_matrices"), WORLD_MATRICES_TIU - GL_TEXTURE0);
+        }, std::string{}, sm.program_id);
+
+        const std::pair<const char*, GLenum> moments_shaders[] {
+            { "shaders/occlusion_vertex.glsl", GL_VERTEX_SHADER },
+            { "shaders/shadow_moments_fragment.glsl", GL_FRAGMENT_SHADER },
+        };
+
+        programs.add(moments_shaders, [this] (const GLuint program_id) {
+            sm.moments_program_id = program_id;
+
+            sm.moments_from_depth_loc = glGetUniformLocation(program_id, "u_from_depth");
+            sm.moments_page_loc = glGetUniformLocation(program_id, "u_page");
+            sm.moments_tile_loc = glGetUniformLocation(program_id, "u_tile");
+            sm.moments_direction_loc = glGetUniformLocation(program_id, "u_direction");
+            sm.moments_blur_radius_loc = glGetUniformLocation(program_id, "u_blur_radius");
+
+            glUseProgram(program_id);
+            scope_exit({ glUseProgram(0); });
+            glUniform1i(glGetUniformLocation(program_id, "u_depth_maps"), SM_TIU - GL_TEXTURE0);
+            glUniform1i(glGetUniformLocation(program_id, "u_moments"), 0);
+        }, std::string{}, sm.moments_program_id);
+    }
+
+    scene_object create_ball() {
+        const auto mesh = mesh::gen_sphere(0.5f, 32, 32);
+
+        const auto diffuse_tex_id = gl::load_png_texture("textures/ball_albedo.png");
+
+        const auto mtl = material{ { 0, 0, 0, 1 }, { 1, 1, 1, 1 }, 200, 0.15f };
+
+        auto mtl_buffer_id = GLuint{};
+        glGenBuffers(1, &mtl_buffer_id);
+        glBindBuffer(GL_UNIFORM_BUFFER, mtl_buffer_id);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(mtl), &mtl, GL_DYNAMIC_DRAW);
+
+        return { mesh, mtl, mtl_buffer_id, diffuse_tex_id };
+    }
+
+    scene_object create_plane() {
         const auto mesh = mesh::gen_quad(
             glm::vec3(-5, -0.5, 5), glm::vec3(5, -0.5, 5),
             glm::vec3(5, -0.5, -5), glm::vec3(-5, -0.5, -5));
@@ -522,21 +1771,248 @@ class handler {
         return { mesh, mtl, mtl_buffer_id, diffuse_tex_id, normal_tex_id, height_tex_id };
     }
 
+    instanced_object create_instanced_balls() {
+        auto obj = instanced_object{};
+        obj.mesh = mesh::gen_sphere(0.5f, 16, 16);
+
+        obj.diffuse_array_tex_id = gl::load_png_texture_array({
+            "textures/ball_albedo.png", "textures/ball4_diffuse.png",
+            "textures/ball8_diffuse.png", "textures/ball12_diffuse.png"
+        }, 1024, 512);
+
+        obj.mtl = material{ { 0, 0, 0, 1 }, { 1, 1, 1, 1 }, 200, 0 };
+
+        glGenBuffers(1, &obj.mtl_buffer_id);
+        glBindBuffer(GL_UNIFORM_BUFFER, obj.mtl_buffer_id);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(obj.mtl), &obj.mtl, GL_DYNAMIC_DRAW);
+
+        glGenBuffers(1, &obj.instance_buffer_id);
+        mesh::set_instance_buffer(obj.mesh, obj.instance_buffer_id);
+
+        place_instances(obj, false);
+
+        /* moved by the stress toggle and the transform animation, so it is kept out of the static shadow layer */
+        obj.dynamic = true;
+
+        return obj;
+    }
+
+    void place_instances(instanced_object& obj, const bool stress) {
+        const auto ball = [] (const glm::vec3& pos, const float radius, const float layer) {
+            const auto model = glm::scale(glm::translate(glm::mat4(), pos), glm::vec3(2 * radius));
+            return mesh::instance_data{ model, layer };
+        };
+
+        obj.instances = {};
+
+        if (stress) {
+            const auto spacing = 9.8f / STRESS_INSTANCES_PER_ROW;
+            const auto radius = 0.4f * spacing;
+
+            obj.instances.reserve(STRESS_INSTANCES_PER_ROW * STRESS_INSTANCES_PER_ROW);
+            for (auto row = 0; row < STRESS_INSTANCES_PER_ROW; ++row) {
+                for (auto column = 0; column < STRESS_INSTANCES_PER_ROW; ++column) {
+                    const auto pos = glm::vec3(
+                        -4.9f + (column + 0.5f) * spacing, -0.5f + radius, -4.9f + (row + 0.5f) * spacing);
+                    obj.instances.push_back(ball(pos, radius, static_cast<float>((row + column) % 4)));
+                }
+            }
+        } else {
+            obj.instances.push_back(ball({ 1.5f, -0.25f, 0.5f }, 0.25f, 1));
+            obj.instances.push_back(ball({ -1, -0.25f, 1.5f }, 0.25f, 2));
+            obj.instances.push_back(ball({ 0.5f, -0.25f, -1.5f }, 0.25f, 3));
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, obj.instance_buffer_id);
+        glBufferData(GL_ARRAY_BUFFER, obj.instances.size() * sizeof(obj.instances.front()),
+            obj.instances.data(), GL_STATIC_DRAW);
+    }
+
+    template<typename Function>
+    void for_each_lighting_program(Function&& fn) {
+        scope_exit({ glUseProgram(0); });
+
+        for (auto& variant : scene.programs) {
+            glUseProgram(variant.second.id);
+            fn(variant.second);
+        }
+    }
+
+    template<typename Function>
+    void for_each_screen_lighting_program(Function&& fn) {
+        for_each_lighting_program([&fn] (const lighting_program& program) {
+            if ((program.features & LIGHTING_LAYERED) == 0) fn(program);
+        });
+    }
+
+    const lighting_program& lighting_variant(const unsigned features) {
+        const auto it = scene.programs.find(features);
+        if (it != scene.programs.end()) return it->second;
+
+        const auto program = create_lighting_program(features, sm.samples);
+        for (auto& variant : scene.programs) {
+            if ((variant.first & LIGHTING_LAYERED) != (features & LIGHTING_LAYERED)) continue;
+
+            gl::copy_uniforms(variant.second.id, program.id);
+            break;
+        }
+
+        return scene.programs[features] = program;
+    }
+
+    void create_lighting_variants(gl::program_batch& programs) {
+        for (auto& obj : scene.objs) obj.features = lighting_features(obj);
+        for (auto& obj : scene.instanced_objs) obj.features = lighting_features(obj);
+
+        std::stable_sort(std::begin(scene.objs), std::end(scene.objs),
+            [] (const scene_object& lhs, const scene_object& rhs) { return lhs.features < rhs.features; });
+
+        auto variants = std::set<unsigned>{ 0 };
+        for (auto& obj : scene.objs) variants.insert(obj.features);
+        for (auto& obj : scene.instanced_objs) variants.insert(obj.features);
+
+        for (const auto features : variants) {
+            add_lighting_program(programs, features);
+            add_lighting_program(programs, features | LIGHTING_LAYERED);
+        }
+        add_lighting_program(programs, LIGHTING_SHADOW_MASK);
+    }
+
+    void add_lighting_program(gl::program_batch& programs, const unsigned features) {
+        const auto previous = scene.programs.find(features);
+        const auto previous_program_id = previous != scene.programs.end() ? previous->second.id : 0;
+
+        programs.add(lighting_shaders(features), [this, features] (const GLuint program_id) {
+            const auto program = scene.programs[features] = init_lighting_program(program_id, features);
+
+            glUseProgram(program.id);
+            scope_exit({ glUseProgram(0); });
+            glUniform1f(program.near_loc, camera.near);
+            glUniform1f(program.far_loc, camera.far);
+        }, lighting_defines(features, sm.samples), previous_program_id);
+    }
+
+    void set_shadow_samples(const int samples) {
+        if (samples == sm.samples) return;
+        finish_hot_reload();
+        sm.samples = samples;
+
+        for (auto& variant : scene.programs) {
+            const auto program = create_lighting_program(variant.first, samples);
+            gl::copy_uniforms(variant.second.id, program.id);
+            gl::delete_shader_program(variant.second.id);
+            variant.second = program;
+        }
+    }
+
     void update_shadow_bias_matrices() {
-        glUseProgram(scene.program.id);
+        auto shadow_bias_matrices = std::vector<glm::mat4>(sm.mvp_matrices.size());
+        batch::multiply(depth_bias_matrix, sm.mvp_matrices.data(), shadow_bias_matrices.data(), sm.mvp_matrices.size());
+
+        for_each_lighting_program([&] (const lighting_program& program) {
+            glUniformMatrix4fv(program.shadow_bias_matrices_loc, shadow_bias_matrices.size(), GL_FALSE,
+                glm::value_ptr(shadow_bias_matrices.front()));
+            glUniform4fv(program.shadow_rects_loc, sm.rects.size(), glm::value_ptr(sm.rects.front()));
+            glUniform1iv(program.shadow_pages_loc, sm.pages.size(), sm.pages.data());
+            glUniform2iv(program.light_views_loc, sm.light_views.size(), glm::value_ptr(sm.light_views.front()));
+            glUniform4fv(program.cascade_splits_loc, sm.cascade_splits.size(),
+                glm::value_ptr(sm.cascade_splits.front()));
+        });
+    }
 
-        for (size_t i = 0; i < scene.lights.size(); ++i) {
-            const auto shadow_bias_matrix = depth_bias_matrix * sm.mvp_matrices[i];
+    void render_casters(const bool dynamic, const std::vector<GLint>& views) {
+        const auto view_count = static_cast<GLsizei>(views.size());
+        glUniform1iv(sm.views_loc, view_count, views.data());
+        glUniform1i(sm.view_count_loc, view_count);
+
+        for (auto& obj : scene.objs) {
+            if (obj.dynamic != dynamic) continue;
 
-            glUniformMatrix4fv(scene.program.shadow_bias_matrices_loc[i], 1, GL_FALSE, glm::value_ptr(shadow_bias_matrix));
+            glUniform1i(sm.node_loc, obj.node);
+            glBindVertexArray(obj.mesh.vao_id);
+            glDrawElementsInstanced(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type,
+                nullptr, view_count);
+        }
+
+        glUniform1i(sm.instanced_loc, 1);
+        for (auto& obj : scene.instanced_objs) {
+            if (obj.dynamic != dynamic) continue;
+
+            mesh::set_instance_divisor(obj.mesh, view_count);
+            glDrawElementsInstanced(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type,
+                nullptr, obj.instances.size() * view_count);
+            mesh::set_instance_divisor(obj.mesh, 1);
         }
+        glUniform1i(sm.instanced_loc, 0);
     }
 
-    void sm_prepass() {
-        glBindFramebuffer(GL_FRAMEBUFFER, sm.fbo_id);
+    glm::ivec4 atlas_tile(const GLint view) const {
+        const auto& rect = sm.rects[view];
+        return glm::ivec4(
+            static_cast<int>(rect.x * SM_ATLAS_SIZE), static_cast<int>(rect.y * SM_ATLAS_SIZE),
+            static_cast<int>(rect.z * SM_ATLAS_SIZE), static_cast<int>(rect.w * SM_ATLAS_SIZE));
+    }
+
+    void clear_shadow_views(const GLuint tex_id, const std::vector<GLint>& views) {
+        glBindFramebuffer(GL_FRAMEBUFFER, sm.layer_draw_fbo_id);
+
+        glEnable(GL_SCISSOR_TEST);
+        scope_exit({ glDisable(GL_SCISSOR_TEST); });
+
+        for (auto view : views) {
+            const auto tile = atlas_tile(view);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex_id, 0, sm.pages[view]);
+            glScissor(tile.x, tile.y, tile.z, tile.w);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+    }
+
+    void copy_shadow_views(const std::vector<GLint>& views) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sm.layer_read_fbo_id);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sm.layer_draw_fbo_id);
+
+        for (auto view : views) {
+            const auto tile = atlas_tile(view);
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, sm.static_tex_id, 0, sm.pages[view]);
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, sm.tex_id, 0, sm.pages[view]);
+            glBlitFramebuffer(tile.x, tile.y, tile.x + tile.z, tile.y + tile.w,
+                tile.x, tile.y, tile.x + tile.z, tile.y + tile.w, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        }
+    }
+
+    bool sm_prepass() {
+        auto views = std::vector<GLint>{};
+        auto static_views = std::vector<GLint>{};
+        auto matrices_changed = false;
+
+        for (size_t i = 0; i < sm.mvp_matrices.size(); ++i) {
+            auto& state = sm.states[i];
+
+            const auto light_changed = !state.valid || state.rendered_mvp != sm.mvp_matrices[i] ||
+                state.rendered_rect != sm.rects[i] || state.rendered_page != sm.pages[i];
+            if (!light_changed && !state.statics_changed && !state.dynamics_changed) continue;
+
+            views.push_back(i);
+            if (light_changed || state.statics_changed) static_views.push_back(i);
+
+            matrices_changed = matrices_changed || light_changed;
+            state = { sm.mvp_matrices[i], sm.rects[i], sm.pages[i], true, false, false };
+        }
+
+        /* a view counts once, also when both of its layers are drawn */
+        sm.renders = views.size();
+        if (views.empty()) return false;
+
+        render_shadow_views(views, static_views);
+        if (sm.filter == SM_FILTER_EVSM) build_shadow_moments(views);
+
+        return matrices_changed;
+    }
+
+    void render_shadow_views(const std::vector<GLint>& views, const std::vector<GLint>& static_views) {
         scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
 
-        glViewport(0, 0, SM_WIDTH, SM_HEIGHT);
+        glViewport(0, 0, SM_ATLAS_SIZE, SM_ATLAS_SIZE);
 
         glUseProgram(sm.program_id);
         scope_exit({ glUseProgram(0); });
@@ -544,39 +2020,396 @@ class handler {
         glCullFace(GL_FRONT);
         scope_exit({ glCullFace(GL_BACK); });
 
-        for (size_t i = 0; i < scene.lights.size(); ++i) {
-            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, sm.tex_ids[i], 0);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        for (auto plane = 0; plane < 4; ++plane) glEnable(GL_CLIP_DISTANCE0 + plane);
+        scope_exit({ for (auto plane = 0; plane < 4; ++plane) glDisable(GL_CLIP_DISTANCE0 + plane); });
+
+        glUniformMatrix4fv(sm.depth_mvp_matrices_loc, sm.mvp_matrices.size(), GL_FALSE,
+            glm::value_ptr(sm.mvp_matrices.front()));
+        glUniform4fv(sm.view_rects_loc, sm.rects.size(), glm::value_ptr(sm.rects.front()));
+        glUniform1iv(sm.view_pages_loc, sm.pages.size(), sm.pages.data());
+
+        if (sm.split_static) {
+            if (!static_views.empty()) {
+                clear_shadow_views(sm.static_tex_id, static_views);
+                glBindFramebuffer(GL_FRAMEBUFFER, sm.static_fbo_id);
+                render_casters(false, static_views);
+            }
+
+            copy_shadow_views(views);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, sm.fbo_id);
+            render_casters(true, views);
+        } else {
+            clear_shadow_views(sm.tex_id, views);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, sm.fbo_id);
+            render_casters(false, views);
+            render_casters(true, views);
+        }
+    }
+
+    void build_shadow_moments(const std::vector<GLint>& views) {
+        glBindFramebuffer(GL_FRAMEBUFFER, sm.moments_fbo_id);
+
+        glUseProgram(sm.moments_program_id);
+        glBindVertexArray(fullscreen_quad.vao_id);
+
+        glDisable(GL_DEPTH_TEST);
+        glBindSampler(SM_TIU - GL_TEXTURE0, sm.depth_sampler_id);
+        scope_exit({
+            glEnable(GL_DEPTH_TEST);
+            glBindSampler(SM_TIU - GL_TEXTURE0, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glUseProgram(0);
+            glActiveTexture(GL_TEXTURE0);
+        });
+
+        glActiveTexture(GL_TEXTURE0);
+
+        for (auto view : views) {
+            const auto tile = atlas_tile(view);
+            glViewport(tile.x, tile.y, tile.z, tile.w);
+            glUniform4i(sm.moments_tile_loc, tile.x, tile.y, tile.x + tile.z - 1, tile.y + tile.w - 1);
+            glUniform1i(sm.moments_page_loc, sm.pages[view]);
+
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sm.moments_blur_tex_id, 0);
+            glUniform1i(sm.moments_from_depth_loc, 1);
+            glUniform2i(sm.moments_direction_loc, 1, 0);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+
+            glBindTexture(GL_TEXTURE_2D, sm.moments_blur_tex_id);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sm.moments_tex_id, 0, sm.pages[view]);
+            glUniform1i(sm.moments_from_depth_loc, 0);
+            glUniform2i(sm.moments_direction_loc, 0, 1);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+
+        build_shadow_moments_mipmaps(views);
+    }
+
+    /* glGenerateMipmap would rebuild the whole atlas, so only the tiles of views are halved level by level.
+     * Tiles are powers of two at multiples of their size, a linear blit of half the size is a 2x2 box filter. */
+    void build_shadow_moments_mipmaps(const std::vector<GLint>& views) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sm.moments_read_fbo_id);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sm.moments_fbo_id);
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+
+        for (auto view : views) {
+            const auto tile = atlas_tile(view);
+
+            for (auto level = 1; level <= SM_MOMENTS_MAX_LEVEL; ++level) {
+                const auto src = tile / (1 << (level - 1));
+                const auto dst = tile / (1 << level);
+
+                glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sm.moments_tex_id, level - 1,
+                    sm.pages[view]);
+                glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sm.moments_tex_id, level,
+                    sm.pages[view]);
+                glBlitFramebuffer(src.x, src.y, src.x + src.z, src.y + src.w,
+                    dst.x, dst.y, dst.x + dst.z, dst.y + dst.w, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            }
+        }
+    }
+
+    void set_shadow_filter(const int filter) {
+        sm.filter = filter;
+        invalidate_shadow_maps();
+
+        for_each_lighting_program([filter] (const lighting_program& program) {
+            glUniform1i(program.shadow_filter_loc, filter);
+        });
+    }
+
+    void create_clusters() {
+        clustered.cpu_ms = 0;
 
-            glUniformMatrix4fv(sm.depth_mvp_matrix_loc, 1, GL_FALSE, glm::value_ptr(sm.mvp_matrices[i]));
+        const auto create_buffer_texture = [] (GLuint& buffer_id, GLuint& tex_id, const GLenum internal_format) {
+            glGenBuffers(1, &buffer_id);
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer_id);
+            glGenTextures(1, &tex_id);
+            glBindTexture(GL_TEXTURE_BUFFER, tex_id);
+            glTexBuffer(GL_TEXTURE_BUFFER, internal_format, buffer_id);
+        };
+
+        create_buffer_texture(clustered.grid_buffer_id, clustered.grid_tex_id, GL_RG32UI);
+        create_buffer_texture(clustered.index_buffer_id, clustered.index_tex_id, GL_R16UI);
+        create_buffer_texture(clustered.light_buffer_id, clustered.light_tex_id, GL_RGBA32F);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        place_point_lights(CLUSTERED_DEFAULT_LIGHTS);
+    }
 
-            for (auto& obj : scene.objs) {
-                glBindVertexArray(obj.mesh.vao_id);
-                glDrawElements(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type, nullptr);
+    void place_point_lights(const int count) {
+        scene.point_lights = {};
+        scene.point_lights.reserve(count);
+
+        for (auto i = 0; i < count; ++i) {
+            const auto distance = 4.9f * std::sqrt((i + 0.5f) / count);
+            const auto angle = 2.3999632f * i;
+            const auto height = -0.4f + 0.8f * std::fmod(0.618034f * i, 1.0f);
+            const auto color = 0.5f * glm::vec3(
+                0.5f + 0.5f * std::cos(angle), 0.5f + 0.5f * std::cos(angle + 2.0944f),
+                0.5f + 0.5f * std::cos(angle + 4.1888f));
+
+            scene.point_lights.push_back({
+                { distance * std::cos(angle), height, distance * std::sin(angle) },
+                CLUSTERED_LIGHT_RADIUS,
+                { color, 1 }
+            });
+        }
+    }
+
+    /* Touches nothing but the camera matrices, scene.point_lights and clustered, so it may run as a job. */
+    void assign_clusters() {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        const auto count = scene.point_lights.size();
+        clustered.x.resize(count);
+        clustered.y.resize(count);
+        clustered.z.resize(count);
+        clustered.radius.resize(count);
+        clustered.visible.resize(count);
+
+        const auto frustum = batch::extract_frustum(transf.mvp_matrix);
+        jobs.parallel_for(0, count, CLUSTERED_CULL_GRAIN, [&] (const size_t first, const size_t last) {
+            for (auto i = first; i < last; ++i) {
+                const auto& l = scene.point_lights[i];
+                clustered.x[i] = l.pos.x;
+                clustered.y[i] = l.pos.y;
+                clustered.z[i] = l.pos.z;
+                clustered.radius[i] = l.radius;
             }
+
+            batch::cull_spheres(frustum, clustered.x.data() + first, clustered.y.data() + first,
+                clustered.z.data() + first, clustered.radius.data() + first, last - first,
+                clustered.visible.data() + first);
+        });
+
+        clustered.lights_eyespace.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (!clustered.visible[i]) continue;
+
+            const auto& l = scene.point_lights[i];
+            const auto pos_eyespace = transf.mv_matrix * glm::vec4(l.pos, 1);
+            clustered.lights_eyespace.push_back({ { glm::vec3(pos_eyespace), l.radius }, l.color });
+        }
+
+        clusters::assign(clustered.lights_eyespace, transf.projection_matrix, camera.near, camera.far, jobs,
+            clustered.grid);
+
+        const auto end = std::chrono::high_resolution_clock::now();
+        clustered.cpu_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    void upload_clusters() {
+        const auto& grid = clustered.grid;
+        glBindBuffer(GL_TEXTURE_BUFFER, clustered.grid_buffer_id);
+        glBufferData(GL_TEXTURE_BUFFER, grid.ranges.size() * sizeof(grid.ranges.front()), grid.ranges.data(),
+            GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, clustered.index_buffer_id);
+        glBufferData(GL_TEXTURE_BUFFER, grid.indices.size() * sizeof(GLushort), grid.indices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, clustered.light_buffer_id);
+        glBufferData(GL_TEXTURE_BUFFER, clustered.lights_eyespace.size() * sizeof(clusters::point_light),
+            clustered.lights_eyespace.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void set_shader_constants() {
+        gl::set_shader_constant("MAX_LIGHTS", MAX_LIGHTS);
+        gl::set_shader_constant("MAX_SHADOW_VIEWS", MAX_SHADOW_VIEWS);
+        gl::set_shader_constant("CLUSTER_GRID_X", clusters::GRID_X);
+        gl::set_shader_constant("CLUSTER_GRID_Y", clusters::GRID_Y);
+        gl::set_shader_constant("CLUSTER_GRID_Z", clusters::GRID_Z);
+    }
+
+    void create_hot_reload() {
+        hot_reload.watcher.reset(new file_watcher{{ "shaders", "shaders/common" }});
+    }
+
+    void add_reloadable_programs(gl::program_batch& programs) {
+        debug.add_program(programs);
+        create_depth_shader(programs);
+        create_pyramid_shader(programs);
+        create_skybox_shader(programs);
+        add_ssao_programs(programs);
+        create_sm_shader(programs);
+        create_temporal_shader(programs);
+        create_ui_shader(programs);
+        for (const auto& variant : scene.programs) add_lighting_program(programs, variant.first);
+    }
+
+    /* Changed shaders are read and compiled in the background, the programs are swapped once the driver
+     * reports them complete. A program that fails to build keeps running its previous version. */
+    void update_hot_reload() {
+        if (hot_reload.pending) {
+            if (!hot_reload.pending->ready()) return;
+            finish_hot_reload();
+        }
+
+        const auto changed_files = hot_reload.watcher->changed_files();
+        if (changed_files.empty()) return;
+
+        hot_reload.pending.reset(new gl::program_batch{changed_files});
+        add_reloadable_programs(*hot_reload.pending);
+        if (hot_reload.pending->empty()) {
+            hot_reload.pending.reset();
+            return;
+        }
+
+        hot_reload.pending->submit();
+    }
+
+    void finish_hot_reload() {
+        if (!hot_reload.pending) return;
+
+        hot_reload.pending->finish();
+        for (const auto& error : hot_reload.pending->errors()) std::cerr << error << std::endl;
+        hot_reload.pending.reset();
+
+        invalidate_shadow_maps();
+        for (auto& probe : reflection.probes) probe.dirty_faces = 0x3f;
+    }
+
+    void create_benchmark() {
+        glGenQueries(2, benchmark.query_ids);
+        benchmark.step = -1;
+    }
+
+    void start_benchmark(const int kind) {
+        if (benchmark.step >= 0) return;
+
+        benchmark.kind = kind;
+        benchmark.lights = scene.lights;
+        benchmark.point_light_count = scene.point_lights.size();
+        benchmark.filter = sm.filter;
+        benchmark.step = 0;
+        benchmark.frame = 0;
+        benchmark.queries_issued = 0;
+        benchmark.gpu_time = 0;
+        benchmark.cpu_time = 0;
+
+        std::cout << (kind == BENCHMARK_CLUSTERS ? "point lights\tindices\tcpu ms\tgpu ms" : "lights\tfilter\tgpu ms") <<
+            std::endl;
+        apply_benchmark_step();
+    }
+
+    void apply_benchmark_step() {
+        if (benchmark.kind == BENCHMARK_CLUSTERS) {
+            place_point_lights(BENCHMARK_POINT_LIGHT_COUNTS[benchmark.step]);
+            return;
+        }
+
+        const auto light_count = BENCHMARK_LIGHT_COUNTS[benchmark.step / 2];
+
+        scene.lights = {};
+        for (auto i = 0; i < light_count; ++i) {
+            const auto angle = 6.2831853f * i / light_count;
+            scene.lights.push_back({ { 20 * std::cos(angle), 15, 20 * std::sin(angle), 1 }, { 0.7f, 0.7f, 0.7f, 1 } });
+        }
+
+        set_shadow_filter(benchmark.step % 2 == 0 ? SM_FILTER_PCF : SM_FILTER_EVSM);
+    }
+
+    /* Reads the previous frame's query like gpu_timer, so the GPU is never drained right after glEndQuery.
+     * The result lags by one frame, which the warmup frames of each step cover. */
+    void update_benchmark() {
+        if (++benchmark.queries_issued < 2) return;
+
+        auto elapsed_ns = GLuint64{};
+        glGetQueryObjectui64v(benchmark.query_ids[benchmark.queries_issued % 2], GL_QUERY_RESULT, &elapsed_ns);
+
+        if (++benchmark.frame > BENCHMARK_WARMUP_FRAMES) {
+            benchmark.gpu_time += elapsed_ns / 1e6;
+            benchmark.cpu_time += clustered.cpu_ms;
+        }
+        if (benchmark.frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES) return;
+
+        if (benchmark.kind == BENCHMARK_CLUSTERS) {
+            std::cout << scene.point_lights.size() << "\t" << clustered.grid.indices.size() << "\t" <<
+                benchmark.cpu_time / BENCHMARK_FRAMES << "\t" << benchmark.gpu_time / BENCHMARK_FRAMES << std::endl;
+        } else {
+            std::cout << scene.lights.size() << "\t" << (sm.filter == SM_FILTER_EVSM ? "evsm" : "pcf") << "\t" <<
+                benchmark.gpu_time / BENCHMARK_FRAMES << std::endl;
+        }
+
+        benchmark.frame = 0;
+        benchmark.gpu_time = 0;
+        benchmark.cpu_time = 0;
+
+        const auto steps = benchmark.kind == BENCHMARK_CLUSTERS
+            ? static_cast<int>(array_length(BENCHMARK_POINT_LIGHT_COUNTS))
+            : 2 * static_cast<int>(array_length(BENCHMARK_LIGHT_COUNTS));
+        if (++benchmark.step < steps) {
+            apply_benchmark_step();
+            return;
+        }
+
+        benchmark.step = -1;
+        if (benchmark.kind == BENCHMARK_CLUSTERS) {
+            place_point_lights(static_cast<int>(benchmark.point_light_count));
+            ui.clustered.benchmark->set_min_max(0, 1, 0);
+        } else {
+            scene.lights = benchmark.lights;
+            set_shadow_filter(benchmark.filter);
+            ui.sm.benchmark->set_min_max(0, 1, 0);
         }
     }
 
+    /* The only full resolution geometry pass besides lighting, which reuses its depth. */
     void depth_prepass() {
-        glBindFramebuffer(GL_FRAMEBUFFER, depth.fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, scene_target.prepass_fbo_id);
         scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
 
-        glViewport(0, 0, SSAO_MAP_WIDTH, SSAO_MAP_HEIGHT);
+        glClearColor(0, 0, 1, 0);
+        scope_exit({ glClearColor(0.2f, 0.3f, 0.8f, 1); });
+
+        glViewport(0, 0, static_cast<int>(framebuffer_size.x), static_cast<int>(framebuffer_size.y));
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glUseProgram(depth.program_id);
         scope_exit({ glUseProgram(0); });
 
-        glUniform1f(depth.near_loc, camera.near);
         glUniform1f(depth.far_loc, camera.far);
 
         for (auto& obj : scene.objs) {
+            if (!obj.visible) continue;
+
+            glUniform1i(depth.node_loc, obj.node);
             glBindVertexArray(obj.mesh.vao_id);
             glDrawElements(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type, nullptr);
         }
 
-        transf.depth_bias_matrix = depth_bias_matrix * transf.mvp_matrix;
-        update_transf_ubo();
+        glUniform1i(depth.instanced_loc, 1);
+        for (auto& obj : scene.instanced_objs) {
+            if (!obj.visible) continue;
+
+            glBindVertexArray(obj.mesh.vao_id);
+            glDrawElementsInstanced(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type,
+                nullptr, obj.instances.size());
+        }
+        glUniform1i(depth.instanced_loc, 0);
+
+        transf.depth_bias_matrix = depth_bias_matrix * transf.mvp_matrix;
+        update_transf_ubo();
+    }
+
+    void depth_resolve_pass() {
+        glBindFramebuffer(GL_FRAMEBUFFER, depth.fbo_id);
+        glUseProgram(depth.resolve_program_id);
+        scope_exit({
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glUseProgram(0);
+        });
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, scene_target.normal_depth_tex_id);
+        glUniform2f(depth.resolve_target_size_loc, ssao.width, ssao.height);
+
+        glViewport(0, 0, ssao.width, ssao.height);
+        glBindVertexArray(fullscreen_quad.vao_id);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
     }
 
     void ssao_pass() {
@@ -586,10 +2419,10 @@ class handler {
         glClearColor(1, 1, 1, 1);
         scope_exit({ glClearColor(0.2f, 0.3f, 0.8f, 1); });
 
-        glViewport(0, 0, SSAO_MAP_WIDTH, SSAO_MAP_HEIGHT);
+        glViewport(0, 0, ssao.width, ssao.height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUseProgram(ssao.program_id);
+        glUseProgram(ssao.program.id);
         scope_exit({
             glUseProgram(0);
             glActiveTexture(GL_TEXTURE0);
@@ -604,21 +2437,23 @@ class handler {
         glDrawArrays(GL_TRIANGLES, 0, 6); 
     }
 
-    void blur_ssao_pass() {
+    void blur_ssao_pass(const GLuint source_tex_id) {
         glBindFramebuffer(GL_FRAMEBUFFER, ssao.fbo_id);
         scope_exit({
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
             glUseProgram(0);
         });
 
-        glViewport(0, 0, SSAO_MAP_WIDTH, SSAO_MAP_HEIGHT);
+        glViewport(0, 0, ssao.width, ssao.height);
 
         glBindVertexArray(fullscreen_quad.vao_id);
 
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, depth.tex_id);
         glActiveTexture(GL_TEXTURE0);
 
         glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ssao.blurred_tex_id, 0);
-        glBindTexture(GL_TEXTURE_2D, ssao.tex_id);
+        glBindTexture(GL_TEXTURE_2D, source_tex_id);
         glUseProgram(ssao.hblur_program_id);
         glUniform1i(ssao.hblur_sampler_loc, 0);
 
@@ -634,124 +2469,460 @@ class handler {
         glDrawArrays(GL_TRIANGLES, 0, 6);
     }
 
-    void reflection_pass() {
-        glBindFramebuffer(GL_FRAMEBUFFER, reflection.fbo_id);
-        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+    void begin_temporal_frame() {
+        const auto golden_angle = 2.39996323f * temporal.frame;
+        const auto noise_offset = glm::vec2{
+            std::fmod(temporal.frame * 0.7548776662f, 1.0f),
+            std::fmod(temporal.frame * 0.5698402910f, 1.0f)
+        };
+
+        for_each_ssao_program([&noise_offset] (const ssao_program& program) {
+            glUniform2fv(program.noise_offset_loc, 1, glm::value_ptr(noise_offset));
+        });
+
+        for_each_screen_lighting_program([golden_angle] (const lighting_program& program) {
+            glUniform2f(program.shadow_rotation_loc, std::cos(golden_angle), std::sin(golden_angle));
+        });
+
+        const auto normal_reprojection_matrix =
+            glm::mat3(temporal.prev_mv_matrix) * glm::inverse(glm::mat3(transf.mv_matrix));
 
-        glUseProgram(scene.program.id);
+        glUseProgram(temporal.program_id);
         scope_exit({ glUseProgram(0); });
+        glUniformMatrix4fv(temporal.reprojection_matrix_loc, 1, GL_FALSE,
+            glm::value_ptr(temporal.prev_mvp_matrix * glm::inverse(transf.mv_matrix)));
+        glUniformMatrix3fv(temporal.normal_reprojection_matrix_loc, 1, GL_FALSE,
+            glm::value_ptr(normal_reprojection_matrix));
+        glUniform2f(temporal.projection_scale_loc, transf.projection_matrix[0][0], transf.projection_matrix[1][1]);
+        glUniform1f(temporal.far_loc, camera.far);
+    }
+
+    void end_temporal_frame() {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, depth.fbo_id);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, temporal.prev_normal_depth_fbo_id);
+        glBlitFramebuffer(0, 0, ssao.width, ssao.height, 0, 0, ssao.width, ssao.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        temporal.prev_mv_matrix = transf.mv_matrix;
+        temporal.prev_mvp_matrix = transf.mvp_matrix;
+        ++temporal.frame;
+    }
 
-        glUniform4fv(scene.program.camera_pos_worldspace_loc, 1,
-            glm::value_ptr(camera.center));
+    GLuint temporal_filter_pass(temporal_filter& filter, const GLuint source_tex_id) {
+        const auto history_tex_id = filter.history_tex_ids[filter.current];
+        filter.current ^= 1;
+        const auto target_tex_id = filter.history_tex_ids[filter.current];
 
-        const auto old_transf = transf;
+        glBindFramebuffer(GL_FRAMEBUFFER, filter.fbo_id);
+        glUseProgram(temporal.program_id);
         scope_exit({
-            transf = old_transf;
-            update_transf_ubo();
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glUseProgram(0);
             glActiveTexture(GL_TEXTURE0);
         });
 
-        perspective(90.0f, static_cast<float>(SPHERE_REFLECTION_MAP_WIDTH) / SPHERE_REFLECTION_MAP_HEIGHT,
-            0.1f, 50.0f);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target_tex_id, 0);
+        glViewport(0, 0, ssao.width, ssao.height);
 
-        const glm::vec3 directions[][2] {
-            { { 1, 0, 0 },  { 0, -1, 0 } },
-            { { -1, 0, 0 }, { 0, -1, 0 } },
-            { { 0, 1, 0 },  { 0, 0, -1 } },
-            { { 0, -1, 0 }, { 0, 0, -1 } },
-            { { 0, 0, 1 },  { 0, -1, 0 } },
-            { { 0, 0, -1 }, { 0, -1, 0 } },
-        };
+        glUniform1i(temporal.history_valid_loc, filter.history_valid);
 
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, source_tex_id);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, history_tex_id);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, depth.tex_id);
         glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, ssao.tex_id);
+        glBindTexture(GL_TEXTURE_2D, temporal.prev_normal_depth_tex_id);
+
+        glBindVertexArray(fullscreen_quad.vao_id);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        filter.history_valid = true;
+        return target_tex_id;
+    }
+
+    /* Screen space over the resolved prepass, the raw mask then only goes through the temporal reprojection,
+     * there is no spatial filter besides the bilateral upsampling in lighting. */
+    void shadow_mask_pass() {
+        glBindFramebuffer(GL_FRAMEBUFFER, temporal.shadow_mask_fbo_id);
+        glUseProgram(lighting_variant(LIGHTING_SHADOW_MASK).id);
+        scope_exit({
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glUseProgram(0);
+            glActiveTexture(GL_TEXTURE0);
+        });
+
+        glActiveTexture(GL_TEXTURE8);
+        glBindTexture(GL_TEXTURE_2D, depth.tex_id);
+
+        glViewport(0, 0, ssao.width, ssao.height);
+        glBindVertexArray(fullscreen_quad.vao_id);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+    void ssao_compute_pass() {
+        glUseProgram(ssao.compute_program.id);
+        scope_exit({
+            glUseProgram(0);
+            glActiveTexture(GL_TEXTURE0);
+        });
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, ssao.noise_tex_id);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, depth.tex_id);
+        glBindImageTexture(0, ssao.tex_id, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+
+        glDispatchCompute(
+            (ssao.width + SSAO_TILE_SIZE - 1) / SSAO_TILE_SIZE,
+            (ssao.height + SSAO_TILE_SIZE - 1) / SSAO_TILE_SIZE, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    /* Point lights farther than radius from the probe are ignored like casters, directional lights always count. */
+    bool probe_lights_changed(const reflection_probe& probe) const {
+        if (probe.seen_lights.size() != scene.lights.size()) return true;
+
+        const auto near_probe = [&probe] (const light& l) {
+            return l.pos.w == 0 || glm::distance(glm::vec3(l.pos), probe.pos) <= probe.radius;
+        };
+
+        for (size_t i = 0; i < scene.lights.size(); ++i) {
+            const auto& seen = probe.seen_lights[i];
+            const auto& current = scene.lights[i];
+            if (seen.pos == current.pos && seen.color == current.color) continue;
+            if (near_probe(seen) || near_probe(current)) return true;
+        }
+        return false;
+    }
+
+    void schedule_reflection_probes(const float now) {
+        for (auto& probe : reflection.probes) {
+            switch (probe.mode) {
+            case PROBE_UPDATE_ON_CHANGE:
+                if (probe.casters_changed || probe_lights_changed(probe)) probe.dirty_faces = 0x3f;
+                break;
+            case PROBE_UPDATE_ROUND_ROBIN:
+                if (probe.dirty_faces == 0) probe.dirty_faces = 0x3f;
+                break;
+            case PROBE_UPDATE_FIXED_RATE:
+                if (now - probe.last_update >= probe.interval) {
+                    probe.dirty_faces = 0x3f;
+                    probe.last_update = now;
+                }
+                break;
+            }
+
+            probe.casters_changed = false;
+            probe.seen_lights = scene.lights;
+        }
+    }
+
+    void depth_pyramid_pass() {
+        glBindFramebuffer(GL_FRAMEBUFFER, depth.pyramid_fbo_id);
+        glUseProgram(depth.pyramid_program_id);
+        glBindVertexArray(fullscreen_quad.vao_id);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depth.tex_id);
+
+        scope_exit({
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, depth.levels - 1);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glUseProgram(0);
+        });
+
+        for (auto level = 1; level < depth.levels; ++level) {
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, depth.tex_id, level);
+            glViewport(0, 0, std::max(ssao.width >> level, 1), std::max(ssao.height >> level, 1));
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+    }
+
+    /* Both targets are GL_RGBA8, as a multisample resolve requires. The second blit is single sampled,
+     * so the default framebuffer may have any color format. */
+    void resolve_scene_color() {
+        const auto width = static_cast<int>(framebuffer_size.x), height = static_cast<int>(framebuffer_size.y);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_target.fbo_id);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, ssr.color_fbo_id);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, ssr.color_fbo_id);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        ssr.prev_mvp_matrix = transf.mvp_matrix;
+    }
+
+    void reflection_pass() {
+        auto order = std::vector<size_t>(reflection.probes.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        /* waiting raises the priority, so a low priority probe cannot be starved by higher ones */
+        const auto urgency = [this] (const size_t i) {
+            const auto& probe = reflection.probes[i];
+            return probe.priority + PROBE_AGE_PRIORITY * probe.frames_waiting;
+        };
+        std::stable_sort(std::begin(order), std::end(order), [&urgency] (const size_t lhs, const size_t rhs) {
+            return urgency(lhs) > urgency(rhs);
+        });
+
+        auto budget = reflection.face_budget;
+        reflection.faces_rendered = 0;
+
+        for (auto i : order) {
+            auto& probe = reflection.probes[i];
+
+            const auto max_faces = static_cast<size_t>(std::max(std::min(probe.faces_per_update, budget), 0));
+
+            auto faces = std::vector<GLint>{};
+            for (auto step = 0; step < 6 && faces.size() < max_faces; ++step) {
+                const auto face = (probe.next_face + step) % 6;
+                if (probe.dirty_faces & (1 << face)) faces.push_back(face);
+            }
+            if (faces.empty()) {
+                if (probe.dirty_faces != 0) ++probe.frames_waiting;
+                continue;
+            }
+            probe.frames_waiting = 0;
+
+            for (auto face : faces) probe.dirty_faces &= ~(1 << face);
+            probe.next_face = (faces.back() + 1) % 6;
+
+            render_reflection_probe(probe, faces);
+
+            budget -= faces.size();
+            reflection.faces_rendered += faces.size();
+        }
+    }
+
+    void clear_probe_faces(const reflection_probe& probe, const std::vector<GLint>& faces) {
+        if (faces.size() == 6) {
+            glBindFramebuffer(GL_FRAMEBUFFER, probe.fbo_id);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            return;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, reflection.face_fbo_id);
+        for (auto face : faces) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                probe.tex_id, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                probe.depth_tex_id, 0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+    }
+
+    void render_reflection_probe(const reflection_probe& probe, const std::vector<GLint>& faces) {
+        scope_exit({
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glUseProgram(0);
+            glActiveTexture(GL_TEXTURE0);
+        });
+
+        const auto face_count = static_cast<GLsizei>(faces.size());
+
+        update_cube_transf_ubo(probe.pos);
+
+        glViewport(0, 0, SPHERE_REFLECTION_MAP_WIDTH, SPHERE_REFLECTION_MAP_HEIGHT);
+        clear_probe_faces(probe, faces);
+        glBindFramebuffer(GL_FRAMEBUFFER, probe.fbo_id);
+
         glActiveTexture(GL_TEXTURE4);
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-        for (auto face = 0; face < 6; ++face) {
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
-                reflection.tex_id, 0);
+        glUseProgram(scene.skybox.layered_program_id);
+        glUniform1iv(scene.skybox.faces_loc, face_count, faces.data());
 
-            glViewport(0, 0, SPHERE_REFLECTION_MAP_WIDTH, SPHERE_REFLECTION_MAP_HEIGHT);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glActiveTexture(GL_TEXTURE0);
+        render_skybox(face_count);
+
+        auto current = static_cast<const lighting_program*>(nullptr);
+        const auto use_program = [&] (const unsigned features) -> const lighting_program& {
+            const auto& program = lighting_variant(features | LIGHTING_LAYERED);
+            if (&program == current) return program;
+
+            current = &program;
+            glUseProgram(program.id);
+            glUniform4fv(program.camera_pos_worldspace_loc, 1, glm::value_ptr(probe.pos));
+            glUniform1iv(program.faces_loc, face_count, faces.data());
+            glUniform1i(program.face_count_loc, face_count);
+            return program;
+        };
+
+        for (auto& obj : scene.objs) {
+            const auto& program = use_program(obj.features);
+            glUniform1i(program.node_loc, obj.node);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, obj.diffuse_tex_id);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, obj.normal_tex_id);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, obj.height_tex_id);
 
-			look_at(camera.center, directions[face][0], directions[face][1]);
-            update_transf_ubo();
-
-            render_skybox();
-            glUseProgram(scene.program.id);
-
-            for (auto& obj : scene.objs) {
-                glUniform1i(scene.program.diffuse_textured_loc, obj.diffuse_tex_id != 0);
-                glUniform1i(scene.program.normal_textured_loc, obj.normal_tex_id != 0);
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, obj.diffuse_tex_id);
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, obj.normal_tex_id);
-                glActiveTexture(GL_TEXTURE4);
-                glBindTexture(GL_TEXTURE_2D, obj.height_tex_id);
-
-                glBindBufferBase(GL_UNIFORM_BUFFER, mtl_binding_point, obj.mtl_buffer_id);
-                glBindVertexArray(obj.mesh.vao_id);
-                glDrawElements(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type, nullptr);
+            glBindBufferBase(GL_UNIFORM_BUFFER, mtl_binding_point, obj.mtl_buffer_id);
+            glBindVertexArray(obj.mesh.vao_id);
+            glDrawElementsInstanced(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type,
+                nullptr, face_count);
+        }
+
+        render_instanced_objects(use_program, face_count);
+    }
+
+    GLuint nearest_reflection_probe(const glm::vec3& pos) const {
+        auto tex_id = GLuint{};
+        auto nearest = FLT_MAX;
+
+        for (auto& probe : reflection.probes) {
+            const auto distance = glm::length(probe.pos - pos);
+            if (distance < nearest) {
+                nearest = distance;
+                tex_id = probe.tex_id;
             }
         }
+
+        return tex_id;
     }
 
     void lighting_pass() {
+        glBindFramebuffer(GL_FRAMEBUFFER, scene_target.fbo_id);
+        scope_exit({ glBindFramebuffer(GL_FRAMEBUFFER, 0); });
+
         glViewport(0, 0, static_cast<int>(framebuffer_size.x), static_cast<int>(framebuffer_size.y));
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClear(early_z.enabled ? GL_COLOR_BUFFER_BIT : GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        if (early_z.enabled) {
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        if (early_z.overdraw) {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+
+        render_lit_objects();
 
-        render_skybox();
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+
+        if (!early_z.overdraw) render_skybox();
+    }
 
-        glUseProgram(scene.program.id);
+    void render_lit_objects() {
         scope_exit({
             glUseProgram(0);
             glActiveTexture(GL_TEXTURE0);
         });
 
         glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, ssao.tex_id);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, reflection.tex_id);
+        glBindTexture(GL_TEXTURE_2D, ssao.result_tex_id);
+        glActiveTexture(GL_TEXTURE8);
+        glBindTexture(GL_TEXTURE_2D, depth.tex_id);
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, ssr.color_tex_id);
+        glActiveTexture(GL_TEXTURE12);
+        glBindTexture(GL_TEXTURE_BUFFER, clustered.grid_tex_id);
+        glActiveTexture(GL_TEXTURE13);
+        glBindTexture(GL_TEXTURE_BUFFER, clustered.index_tex_id);
+        glActiveTexture(GL_TEXTURE14);
+        glBindTexture(GL_TEXTURE_BUFFER, clustered.light_tex_id);
+
+        const auto reprojection_matrix = ssr.prev_mvp_matrix * glm::inverse(transf.mv_matrix);
+        auto current = static_cast<const lighting_program*>(nullptr);
+        const auto use_program = [&] (const unsigned features) -> const lighting_program& {
+            const auto& program = lighting_variant(features);
+            if (&program == current) return program;
+
+            current = &program;
+            glUseProgram(program.id);
+            glUniform1i(program.clustered_loc, !scene.point_lights.empty());
+            glUniform4fv(program.camera_pos_worldspace_loc, 1, glm::value_ptr(camera.eye));
+            glUniformMatrix4fv(program.reprojection_matrix_loc, 1, GL_FALSE, glm::value_ptr(reprojection_matrix));
+            return program;
+        };
 
-        glUniform4fv(scene.program.camera_pos_worldspace_loc, 1, glm::value_ptr(camera.eye));
+        for (auto& obj : scene.objs) {
+            if (!obj.visible) continue;
 
-        for (auto obj : scene.objs) {
-            glUniform1i(scene.program.diffuse_textured_loc, obj.diffuse_tex_id != 0);
-            glUniform1i(scene.program.normal_textured_loc, obj.normal_tex_id != 0);
+            const auto& program = use_program(obj.features);
+            glUniform1i(program.node_loc, obj.node);
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, obj.diffuse_tex_id);
             glActiveTexture(GL_TEXTURE1);
             glBindTexture(GL_TEXTURE_2D, obj.normal_tex_id);
             glActiveTexture(GL_TEXTURE2);
             glBindTexture(GL_TEXTURE_2D, obj.height_tex_id);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, nearest_reflection_probe((obj.bounds_min + obj.bounds_max) / 2.0f));
             glBindBufferBase(GL_UNIFORM_BUFFER, mtl_binding_point, obj.mtl_buffer_id);
             glBindVertexArray(obj.mesh.vao_id);
             glDrawElements(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type, nullptr);
         }
+
+        render_instanced_objects(use_program);
+    }
+
+    template<typename UseProgram>
+    void render_instanced_objects(UseProgram&& use_program, const GLsizei layered_faces = 0) {
+        for (auto& obj : scene.instanced_objs) {
+            /* probe faces look in every direction, the camera frustum only applies to the screen passes */
+            if (layered_faces == 0 && !obj.visible) continue;
+
+            const auto& program = use_program(obj.features);
+            glUniform1i(program.instanced_loc, 1);
+            scope_exit({ glUniform1i(program.instanced_loc, 0); });
+
+            glActiveTexture(GL_TEXTURE5);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, obj.diffuse_array_tex_id);
+            glBindBufferBase(GL_UNIFORM_BUFFER, mtl_binding_point, obj.mtl_buffer_id);
+
+            if (layered_faces > 0) {
+                mesh::set_instance_divisor(obj.mesh, layered_faces);
+                glDrawElementsInstanced(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type,
+                    nullptr, obj.instances.size() * layered_faces);
+                mesh::set_instance_divisor(obj.mesh, 1);
+                continue;
+            }
+
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, nearest_reflection_probe((obj.bounds_min + obj.bounds_max) / 2.0f));
+            glBindVertexArray(obj.mesh.vao_id);
+            glDrawElementsInstanced(obj.mesh.primitive_mode, obj.mesh.num_indices, obj.mesh.index_type,
+                nullptr, obj.instances.size());
+        }
     }
 
-    void render_skybox() {
-        glUseProgram(scene.skybox.program_id);
+    void render_skybox(const GLsizei layered_faces = 0) {
+        glDepthFunc(GL_LEQUAL);
+        scope_exit({ glDepthFunc(GL_LESS); });
+
+        glUseProgram(layered_faces > 0 ? scene.skybox.layered_program_id : scene.skybox.program_id);
         glBindTexture(GL_TEXTURE_CUBE_MAP, scene.skybox.tex_id);
         glBindVertexArray(scene.skybox.mesh.vao_id);
-        glDrawElements(
+        glDrawElementsInstanced(
             scene.skybox.mesh.primitive_mode, scene.skybox.mesh.num_indices,
-            scene.skybox.mesh.index_type, nullptr
+            scene.skybox.mesh.index_type, nullptr, std::max(layered_faces, 1)
         );
     }
 
-    GLuint create_ui_shader() {
+    void create_ui_shader(gl::program_batch& programs) {
         const std::pair<const char*, GLenum> shaders[] {
             { "shaders/ui_vertex.glsl", GL_VERTEX_SHADER },
             { "shaders/ui_fragment.glsl", GL_FRAGMENT_SHADER },
         };
 
-        const auto program_id = gl::load_shader_program(shaders);
-        gl::link_shader_program(program_id);
-
-        return program_id;
+        programs.add(shaders, [this] (const GLuint program_id) {
+            ui.program_id = program_id;
+            ui.transform_loc = glGetUniformLocation(program_id, "u_transform");
+        }, std::string{}, ui.program_id);
     }
 
     void create_fullscreen_quad() {
@@ -775,8 +2946,6 @@ class handler {
     }
 
     void create_ui() {
-        ui.program_id = create_ui_shader();
-        ui.transform_loc = glGetUniformLocation(ui.program_id, "u_transform");
         update_ui_transform();
 
         std::ifstream font_file("fonts/sourcecodepro-light.fnt");
@@ -794,8 +2963,9 @@ class handler {
         ui.ssao.total_strength->set_size(150, 15);
         vlayout->add_widget(ui.ssao.total_strength);
         ui.ssao.total_strength->on_change([this] (const float value) {
-            glUseProgram(ssao.program_id);
-            glUniform1f(ssao.total_strength_loc, value);
+            for_each_ssao_program([value] (const ssao_program& program) {
+                glUniform1f(program.total_strength_loc, value);
+            });
         });
         ui.ssao.total_strength->set_min_max(0.1f, 10.0f, 1.5f);
 
@@ -803,26 +2973,25 @@ class handler {
         ui.ssao.strength->set_size(150, 15);
         vlayout->add_widget(ui.ssao.strength);
         ui.ssao.strength->on_change([this] (const float value) {
-            glUseProgram(ssao.program_id);
-            glUniform1f(ssao.strength_loc, value);
+            for_each_ssao_program([value] (const ssao_program& program) {
+                glUniform1f(program.strength_loc, value);
+            });
         });
         ui.ssao.strength->set_min_max(0.01f, 1.0f, 0.15f);
 
         ui.ssao.sample_count = new ui::slider<int>{"sample_count", ui.p_font, vlayout};
         ui.ssao.sample_count->set_size(150, 15);
         vlayout->add_widget(ui.ssao.sample_count);
-        ui.ssao.sample_count->on_change([this] (const int value) {
-            glUseProgram(ssao.program_id);
-            glUniform1i(ssao.sample_count_loc, value);
-        });
-        ui.ssao.sample_count->set_min_max(0, 16, 16);
+        ui.ssao.sample_count->on_change([this] (const int value) { set_ssao_sample_count(value); });
+        ui.ssao.sample_count->set_min_max(0, 16, SSAO_DEFAULT_SAMPLES);
 
         ui.ssao.offset = new ui::slider<float>{"offset", ui.p_font, vlayout};
         ui.ssao.offset->set_size(150, 15);
         vlayout->add_widget(ui.ssao.offset);
         ui.ssao.offset->on_change([this] (const float value) {
-            glUseProgram(ssao.program_id);
-            glUniform1f(ssao.offset_loc, value);
+            for_each_ssao_program([value] (const ssao_program& program) {
+                glUniform1f(program.offset_loc, value);
+            });
         });
         ui.ssao.offset->set_min_max(1.0f, 30.0f, 30.0f);
 
@@ -830,8 +2999,9 @@ class handler {
         ui.ssao.falloff->set_size(150, 15);
         vlayout->add_widget(ui.ssao.falloff);
         ui.ssao.falloff->on_change([this] (const float value) {
-            glUseProgram(ssao.program_id);
-            glUniform1f(ssao.falloff_loc, value);
+            for_each_ssao_program([value] (const ssao_program& program) {
+                glUniform1f(program.falloff_loc, value);
+            });
         });
         ui.ssao.falloff->set_min_max(0, 0.01f, 0.000002f);
 
@@ -839,26 +3009,55 @@ class handler {
         ui.ssao.radius->set_size(150, 15);
         vlayout->add_widget(ui.ssao.radius);
         ui.ssao.radius->on_change([this] (const float value) {
-            glUseProgram(ssao.program_id);
-            glUniform1f(ssao.radius_loc, value);
+            for_each_ssao_program([value] (const ssao_program& program) {
+                glUniform1f(program.radius_loc, value);
+            });
         });
-        ui.ssao.radius->set_min_max(0.001f, 0.01f, 0.001f);
+        ui.ssao.radius->set_min_max(0.001f, 0.05f, 0.001f);
 
         ui.ssao.depth_bias = new ui::slider<float>{"depth_bias", ui.p_font, vlayout};
         ui.ssao.depth_bias->set_size(150, 15);
         vlayout->add_widget(ui.ssao.depth_bias);
         ui.ssao.depth_bias->on_change([this] (const float value) {
-            glUseProgram(ssao.program_id);
-            glUniform1f(ssao.depth_bias_loc, value);
+            for_each_ssao_program([value] (const ssao_program& program) {
+                glUniform1f(program.depth_bias_loc, value);
+            });
         });
         ui.ssao.depth_bias->set_min_max(0, 0.5f, 0.005f);
 
+        if (ssao.compute_supported) {
+            ui.ssao.compute = new ui::slider<int>{"compute", ui.p_font, vlayout};
+            ui.ssao.compute->set_size(150, 15);
+            vlayout->add_widget(ui.ssao.compute);
+            ui.ssao.compute->on_change([this] (const int path) { ssao.path = path; });
+            ui.ssao.compute->set_min_max(SSAO_PATH_FRAGMENT, SSAO_PATH_COMPUTE, SSAO_PATH_FRAGMENT);
+        }
+
+        ui.ssao.mip_sampling = new ui::slider<int>{"mip_sampling", ui.p_font, vlayout};
+        ui.ssao.mip_sampling->set_size(150, 15);
+        vlayout->add_widget(ui.ssao.mip_sampling);
+        ui.ssao.mip_sampling->on_change([this] (const int value) {
+            for_each_ssao_program([value] (const ssao_program& program) {
+                glUniform1i(program.mip_sampling_loc, value);
+            });
+        });
+        ui.ssao.mip_sampling->set_min_max(0, 1, 1);
+
+        ui.ssao.scale = new ui::slider<float>{"resolution", ui.p_font, vlayout};
+        ui.ssao.scale->set_size(150, 15);
+        vlayout->add_widget(ui.ssao.scale);
+        ui.ssao.scale->on_change([this] (const float value) {
+            ssao.scale = value;
+            resize_ssao();
+        });
+        ui.ssao.scale->set_min_max(0.25f, 1.0f, SSAO_DEFAULT_SCALE);
+
         ui.ssao.hblur_size = new ui::slider<float>{"hblur_size", ui.p_font, vlayout};
         ui.ssao.hblur_size->set_size(150, 15);
         vlayout->add_widget(ui.ssao.hblur_size);
         ui.ssao.hblur_size->on_change([this] (const float value) {
             glUseProgram(ssao.hblur_program_id);
-            glUniform1f(ssao.hblur_size_loc, value / SSAO_MAP_WIDTH);
+            glUniform1f(ssao.hblur_size_loc, value);
         });
         ui.ssao.hblur_size->set_min_max(0.1f, 2.0f, 1.0f);
 
@@ -867,7 +3066,7 @@ class handler {
         vlayout->add_widget(ui.ssao.vblur_size);
         ui.ssao.vblur_size->on_change([this] (const float value) {
             glUseProgram(ssao.vblur_program_id);
-            glUniform1f(ssao.vblur_size_loc, value / SSAO_MAP_HEIGHT);
+            glUniform1f(ssao.vblur_size_loc, value);
         });
         ui.ssao.vblur_size->set_min_max(0.1f, 2.0f, 1.0f);
 
@@ -876,29 +3075,89 @@ class handler {
         ui.sm.samples = new ui::slider<int>{"sample_count", ui.p_font, vlayout};
         ui.sm.samples->set_size(150, 15);
         vlayout->add_widget(ui.sm.samples);
-        ui.sm.samples->on_change([this] (const int samples) {
-            glUseProgram(scene.program.id);
-            glUniform1i(scene.program.shadow_samples_loc, samples);
-        });
-        ui.sm.samples->set_min_max(0, 16, 8);
+        ui.sm.samples->on_change([this] (const int samples) { set_shadow_samples(samples); });
+        ui.sm.samples->set_min_max(0, 16, SM_DEFAULT_SAMPLES);
 
         ui.sm.distance = new ui::slider<float>{"poisson_distance", ui.p_font, vlayout};
         ui.sm.distance->set_size(150, 15);
         vlayout->add_widget(ui.sm.distance);
         ui.sm.distance->on_change([this] (const float distance) {
-            glUseProgram(scene.program.id);
-            glUniform1f(scene.program.shadow_distance_loc, distance);
+            for_each_lighting_program([distance] (const lighting_program& program) {
+                glUniform1f(program.shadow_distance_loc, distance);
+            });
         });
         ui.sm.distance->set_min_max(100.0f, 1000.0f, 600.0f);
 
+        ui.sm.split_static = new ui::slider<int>{"split_static", ui.p_font, vlayout};
+        ui.sm.split_static->set_size(150, 15);
+        vlayout->add_widget(ui.sm.split_static);
+        ui.sm.split_static->on_change([this] (const int split_static) {
+            sm.split_static = split_static != 0;
+            invalidate_shadow_maps();
+        });
+        ui.sm.split_static->set_min_max(0, 1, 0);
+
+        ui.sm.directional = new ui::slider<int>{"directional", ui.p_font, vlayout};
+        ui.sm.directional->set_size(150, 15);
+        vlayout->add_widget(ui.sm.directional);
+        ui.sm.directional->on_change([this] (const int directional) {
+            if (scene.lights.size() > 1) scene.lights[1].pos.w = directional != 0 ? 0.0f : 1.0f;
+        });
+        ui.sm.directional->set_min_max(0, 1, 0);
+
+        ui.sm.cascades = new ui::slider<int>{"cascades", ui.p_font, vlayout};
+        ui.sm.cascades->set_size(150, 15);
+        vlayout->add_widget(ui.sm.cascades);
+        ui.sm.cascades->on_change([this] (const int cascades) { sm.cascade_count = cascades; });
+        ui.sm.cascades->set_min_max(2, MAX_CASCADES, 3);
+
+        ui.sm.cascade_resolution = new ui::slider<int>{"cascade_res", ui.p_font, vlayout};
+        ui.sm.cascade_resolution->set_size(150, 15);
+        vlayout->add_widget(ui.sm.cascade_resolution);
+        ui.sm.cascade_resolution->on_change([this] (const int resolution) { sm.cascade_resolution = resolution; });
+        ui.sm.cascade_resolution->set_min_max(SM_MIN_TILE, SM_MAX_TILE, SM_MAX_TILE / 2);
+
+        ui.sm.filter = new ui::slider<int>{"evsm", ui.p_font, vlayout};
+        ui.sm.filter->set_size(150, 15);
+        vlayout->add_widget(ui.sm.filter);
+        ui.sm.filter->on_change([this] (const int filter) { set_shadow_filter(filter); });
+        ui.sm.filter->set_min_max(SM_FILTER_PCF, SM_FILTER_EVSM, SM_FILTER_PCF);
+
+        ui.sm.blur_radius = new ui::slider<int>{"evsm_blur", ui.p_font, vlayout};
+        ui.sm.blur_radius->set_size(150, 15);
+        vlayout->add_widget(ui.sm.blur_radius);
+        ui.sm.blur_radius->on_change([this] (const int radius) {
+            glUseProgram(sm.moments_program_id);
+            glUniform1i(sm.moments_blur_radius_loc, radius);
+            invalidate_shadow_maps();
+        });
+        ui.sm.blur_radius->set_min_max(0, 8, 2);
+
+        ui.sm.bleed = new ui::slider<float>{"evsm_bleed", ui.p_font, vlayout};
+        ui.sm.bleed->set_size(150, 15);
+        vlayout->add_widget(ui.sm.bleed);
+        ui.sm.bleed->on_change([this] (const float bleed) {
+            for_each_lighting_program([bleed] (const lighting_program& program) {
+                glUniform1f(program.evsm_bleed_loc, bleed);
+            });
+        });
+        ui.sm.bleed->set_min_max(0, 0.9f, 0.2f);
+
+        ui.sm.benchmark = new ui::slider<int>{"benchmark", ui.p_font, vlayout};
+        ui.sm.benchmark->set_size(150, 15);
+        vlayout->add_widget(ui.sm.benchmark);
+        ui.sm.benchmark->on_change([this] (const int run) { if (run != 0) start_benchmark(BENCHMARK_SHADOWS); });
+        ui.sm.benchmark->set_min_max(0, 1, 0);
+
         vlayout->add_widget(new ui::text{"parallax mapping", ui.p_font, vlayout});
 
         ui.parallax.scale = new ui::slider<float>{"scale", ui.p_font, vlayout};
         ui.parallax.scale->set_size(150, 15);
         vlayout->add_widget(ui.parallax.scale);
         ui.parallax.scale->on_change([this] (const float scale) {
-            glUseProgram(scene.program.id);
-            glUniform1f(scene.program.parallax_scale_loc, scale);
+            for_each_lighting_program([scale] (const lighting_program& program) {
+                glUniform1f(program.parallax_scale_loc, scale);
+            });
         });
         ui.parallax.scale->set_min_max(0, 0.1f, 0.005f);
 
@@ -906,13 +3165,157 @@ class handler {
         ui.parallax.bias->set_size(150, 15);
         vlayout->add_widget(ui.parallax.bias);
         ui.parallax.bias->on_change([this] (const float bias) {
-            glUseProgram(scene.program.id);
-            glUniform1f(scene.program.parallax_bias_loc, bias);
+            for_each_lighting_program([bias] (const lighting_program& program) {
+                glUniform1f(program.parallax_bias_loc, bias);
+            });
         });
         ui.parallax.bias->set_min_max(0, 0.1f, 0);
 
+        vlayout->add_widget(new ui::text{"reflection probes", ui.p_font, vlayout});
+
+        ui.probes.mode = new ui::slider<int>{"mode", ui.p_font, vlayout};
+        ui.probes.mode->set_size(150, 15);
+        vlayout->add_widget(ui.probes.mode);
+        ui.probes.mode->on_change([this] (const int mode) {
+            for (auto& probe : reflection.probes) probe.mode = mode;
+        });
+        ui.probes.mode->set_min_max(PROBE_UPDATE_ON_CHANGE, PROBE_UPDATE_FIXED_RATE, PROBE_UPDATE_ON_CHANGE);
+
+        ui.probes.faces = new ui::slider<int>{"faces_per_update", ui.p_font, vlayout};
+        ui.probes.faces->set_size(150, 15);
+        vlayout->add_widget(ui.probes.faces);
+        ui.probes.faces->on_change([this] (const int faces) {
+            for (auto& probe : reflection.probes) probe.faces_per_update = faces;
+        });
+        ui.probes.faces->set_min_max(1, 6, 6);
+
+        ui.probes.rate = new ui::slider<float>{"rate_hz", ui.p_font, vlayout};
+        ui.probes.rate->set_size(150, 15);
+        vlayout->add_widget(ui.probes.rate);
+        ui.probes.rate->on_change([this] (const float rate) {
+            for (auto& probe : reflection.probes) probe.interval = 1 / rate;
+        });
+        ui.probes.rate->set_min_max(1.0f, 60.0f, 10.0f);
+
+        ui.probes.budget = new ui::slider<int>{"face_budget", ui.p_font, vlayout};
+        ui.probes.budget->set_size(150, 15);
+        vlayout->add_widget(ui.probes.budget);
+        ui.probes.budget->on_change([this] (const int budget) { reflection.face_budget = budget; });
+        ui.probes.budget->set_min_max(1, 24, 12);
+
+        vlayout->add_widget(new ui::text{"clustered", ui.p_font, vlayout});
+
+        ui.clustered.count = new ui::slider<int>{"point_lights", ui.p_font, vlayout};
+        ui.clustered.count->set_size(150, 15);
+        vlayout->add_widget(ui.clustered.count);
+        ui.clustered.count->on_change([this] (const int count) { place_point_lights(count); });
+        ui.clustered.count->set_min_max(0, clusters::MAX_POINT_LIGHTS, CLUSTERED_DEFAULT_LIGHTS);
+
+        ui.clustered.benchmark = new ui::slider<int>{"benchmark", ui.p_font, vlayout};
+        ui.clustered.benchmark->set_size(150, 15);
+        vlayout->add_widget(ui.clustered.benchmark);
+        ui.clustered.benchmark->on_change([this] (const int run) { if (run != 0) start_benchmark(BENCHMARK_CLUSTERS); });
+        ui.clustered.benchmark->set_min_max(0, 1, 0);
+
+        vlayout->add_widget(new ui::text{"prepass", ui.p_font, vlayout});
+
+        ui.early_z.enabled = new ui::slider<int>{"z_prepass", ui.p_font, vlayout};
+        ui.early_z.enabled->set_size(150, 15);
+        vlayout->add_widget(ui.early_z.enabled);
+        ui.early_z.enabled->on_change([this] (const int enabled) { early_z.enabled = enabled != 0; });
+        ui.early_z.enabled->set_min_max(0, 1, 1);
+
+        ui.early_z.overdraw = new ui::slider<int>{"overdraw", ui.p_font, vlayout};
+        ui.early_z.overdraw->set_size(150, 15);
+        vlayout->add_widget(ui.early_z.overdraw);
+        ui.early_z.overdraw->on_change([this] (const int overdraw) {
+            early_z.overdraw = overdraw != 0;
+            for_each_screen_lighting_program([overdraw] (const lighting_program& program) {
+                glUniform1i(program.overdraw_loc, overdraw);
+            });
+        });
+        ui.early_z.overdraw->set_min_max(0, 1, 0);
+
+        vlayout->add_widget(new ui::text{"temporal", ui.p_font, vlayout});
+
+        ui.temporal.enabled = new ui::slider<int>{"accumulate", ui.p_font, vlayout};
+        ui.temporal.enabled->set_size(150, 15);
+        vlayout->add_widget(ui.temporal.enabled);
+        ui.temporal.enabled->on_change([this] (const int enabled) { set_temporal(enabled != 0); });
+        ui.temporal.enabled->set_min_max(0, 1, 0);
+
+        ui.temporal.alpha = new ui::slider<float>{"alpha", ui.p_font, vlayout};
+        ui.temporal.alpha->set_size(150, 15);
+        vlayout->add_widget(ui.temporal.alpha);
+        ui.temporal.alpha->on_change([this] (const float alpha) {
+            glUseProgram(temporal.program_id);
+            glUniform1f(temporal.alpha_loc, alpha);
+        });
+        ui.temporal.alpha->set_min_max(0.02f, 0.5f, 0.1f);
+
+        vlayout->add_widget(new ui::text{"SSR", ui.p_font, vlayout});
+
+        ui.ssr.enabled = new ui::slider<int>{"ssr", ui.p_font, vlayout};
+        ui.ssr.enabled->set_size(150, 15);
+        vlayout->add_widget(ui.ssr.enabled);
+        ui.ssr.enabled->on_change([this] (const int mode) { set_reflection_mode(mode); });
+        ui.ssr.enabled->set_min_max(REFLECTION_PROBE, REFLECTION_SSR, REFLECTION_PROBE);
+
+        ui.ssr.max_distance = new ui::slider<float>{"max_distance", ui.p_font, vlayout};
+        ui.ssr.max_distance->set_size(150, 15);
+        vlayout->add_widget(ui.ssr.max_distance);
+        ui.ssr.max_distance->on_change([this] (const float distance) {
+            for_each_screen_lighting_program([distance] (const lighting_program& program) {
+                glUniform1f(program.ssr_max_distance_loc, distance);
+            });
+        });
+        ui.ssr.max_distance->set_min_max(0.5f, 20.0f, 5.0f);
+
+        ui.ssr.thickness = new ui::slider<float>{"thickness", ui.p_font, vlayout};
+        ui.ssr.thickness->set_size(150, 15);
+        vlayout->add_widget(ui.ssr.thickness);
+        ui.ssr.thickness->on_change([this] (const float thickness) {
+            for_each_screen_lighting_program([thickness] (const lighting_program& program) {
+                glUniform1f(program.ssr_thickness_loc, thickness);
+            });
+        });
+        ui.ssr.thickness->set_min_max(0.0005f, 0.02f, 0.002f);
+
+        vlayout->add_widget(new ui::text{"instancing", ui.p_font, vlayout});
+
+        ui.instancing.stress = new ui::slider<int>{"stress", ui.p_font, vlayout};
+        ui.instancing.stress->set_size(150, 15);
+        vlayout->add_widget(ui.instancing.stress);
+        ui.instancing.stress->on_change([this] (const int stress) {
+            for (auto& obj : scene.instanced_objs) {
+                invalidate_caster(obj);
+                place_instances(obj, stress != 0);
+            }
+            build_transform_hierarchy();
+            update_scene_bounds();
+            for (auto& obj : scene.instanced_objs) invalidate_caster(obj);
+        });
+        ui.instancing.stress->set_min_max(0, 1, 0);
+
+        vlayout->add_widget(new ui::text{"transforms", ui.p_font, vlayout});
+
+        ui.transforms.animate = new ui::slider<int>{"animate", ui.p_font, vlayout};
+        ui.transforms.animate->set_size(150, 15);
+        vlayout->add_widget(ui.transforms.animate);
+        ui.transforms.animate->on_change([this] (const int animate) { world_matrices.animate = animate != 0; });
+        ui.transforms.animate->set_min_max(0, 1, 0);
+
+        ui.transforms.stress_nodes = new ui::slider<int>{"stress_nodes", ui.p_font, vlayout};
+        ui.transforms.stress_nodes->set_size(150, 15);
+        vlayout->add_widget(ui.transforms.stress_nodes);
+        ui.transforms.stress_nodes->on_change([this] (const int count) { set_transform_stress_nodes(count); });
+        ui.transforms.stress_nodes->set_min_max(0, TRANSFORM_STRESS_MAX_NODES, 0);
+
         ui.fps = new ui::text{"", ui.p_font, ui.panel.get()};
         ui.fps->set_pos(600, 0);
+
+        ui.timings = new ui::text{"", ui.p_font, ui.panel.get()};
+        ui.timings->set_pos(600, 20);
     }
 
     void update_ui_transform() {
@@ -948,35 +3351,83 @@ public:
         const int fb_width, const int fb_height,
         const int window_width, const int window_height
     ) {
+        const auto start = std::chrono::high_resolution_clock::now();
+
         framebuffer_size = { fb_width, fb_height };
         window_size = { window_width, window_height };
 
+        gl::enable_program_cache("cache");
+        set_shader_constants();
+
+        gl::prefetch_png_files({
+            "textures/ball_albedo.png", "textures/ball4_diffuse.png",
+            "textures/ball8_diffuse.png", "textures/ball12_diffuse.png",
+            "textures/table_cloth_diffuse.png", "textures/table_cloth_normal.png",
+            "textures/table_cloth_height.png", "textures/noise.png"
+        });
+        gl::prefetch_png_texture_cube("textures/skybox");
+
         glEnable(GL_CULL_FACE);
         glEnable(GL_DEPTH_TEST);
         glDepthFunc(GL_LESS);
 
         glClearColor(0.2f, 0.3f, 0.8f, 1);
 
-        debug.init();
+        auto programs = gl::program_batch{};
+
+        debug.init(programs);
 
-        create_scene();
+        create_depth_shader(programs);
+        create_pyramid_shader(programs);
+        create_skybox_shader(programs);
+        create_ssao_shader(programs);
+        create_sm_shader(programs);
+        create_temporal_shader(programs);
+        create_ui_shader(programs);
+        programs.submit();
+
+        create_scene(programs);
+        programs.submit();
+
+        create_ssao_noise();
 
         create_depth_fbo();
         create_ssao_fbo();
-        create_reflection_fbo();
+        create_reflection_probes();
         create_shadow_maps_fbo();
 
-        create_depth_shader();
-        create_ssao_shader();
-        create_sm_shader();
-
-        create_transf_ubo();
-        create_lights_ubo();
+        create_uniform_ring();
         create_shadow_maps();
+        update_transf_ubo();
+        update_lights_ubo();
 
         create_fullscreen_quad();
+        create_ssr();
+        create_scene_target();
+        create_temporal();
+        create_clusters();
+        create_benchmark();
+        create_hot_reload();
+
+        create_gpu_timer(timers.depth);
+        create_gpu_timer(timers.ssao);
+        create_gpu_timer(timers.blur);
+        create_gpu_timer(timers.ssao_compute);
+        create_gpu_timer(timers.temporal);
+        create_gpu_timer(timers.shadow_mask);
+        create_gpu_timer(timers.pyramid);
+        create_gpu_timer(timers.probes);
+        create_gpu_timer(timers.lighting);
+
+        programs.finish();
 
         create_ui();
+
+        const auto end = std::chrono::high_resolution_clock::now();
+        const auto stats = gl::get_program_cache_stats();
+        std::cout << "startup " << std::chrono::duration<double, std::milli>(end - start).count() << " ms: " <<
+            stats.binary_hits << " cached programs, " << stats.binary_misses << " compiled programs, " <<
+            stats.shaders_compiled << " shaders compiled, " << stats.shaders_reused << " shaders reused" << std::endl;
     }
 
     void onCursorMove(const float x, const float y) {
@@ -990,7 +3441,7 @@ public:
         camera_up(-diff.y);
 
 		look_at(camera.eye, camera.center, camera.up);
-        update_transf_ubo();
+        transf_dirty = true;
 
         prev_mouse_pos = glm::vec2(x, y);
     }
@@ -1003,7 +3454,7 @@ public:
 
 		camera.eye = camera.center + length / dir_length * dir;
 		look_at(camera.eye, camera.center, camera.up);
-        update_transf_ubo();
+        transf_dirty = true;
     }
 
     void onMouseButton(const int button, const int action, const int mods,
@@ -1027,41 +3478,144 @@ public:
 
 		look_at(camera.eye, camera.center, camera.up);
         perspective(camera.fovy, static_cast<float>(width) / height, camera.near, camera.far);
-        update_transf_ubo();
+        transf_dirty = true;
         update_ui_transform();
+        resize_scene_target(width, height);
+        resize_ssr_color(width, height);
+        resize_ssao();
+
+        const auto cluster_scale = glm::vec2(clusters::GRID_X, clusters::GRID_Y) / framebuffer_size;
+        for_each_screen_lighting_program([&cluster_scale] (const lighting_program& program) {
+            glUniform2fv(program.cluster_scale_loc, 1, glm::value_ptr(cluster_scale));
+        });
     }
 
     void onUpdate(const float now, const float elapsed) {
         scene.lights[0].pos.x = 20 * std::cos(0.25f * now);
         scene.lights[0].pos.z = 10 * std::sin(0.25f * now);
 
-        update_lights_ubo();
-        calculate_shadow_mvps();
+        update_hot_reload();
+
+        /* light clustering is independent of the scene transforms, it runs beside them */
+        job_counter clusters_assigned;
+        jobs.run(clusters_assigned, [this] { assign_clusters(); });
 
-        sm.update_required = true;
+        animate_transforms(now);
+        update_transforms();
+        update_visibility();
+        update_lights_ubo();
 
-        ui.fps->set_string(std::to_string(static_cast<int>(1.0f / elapsed)));
+        jobs.wait(clusters_assigned);
+        upload_clusters();
+        calculate_shadow_mvps();
+        schedule_reflection_probes(now);
+
+        avg_frame_time = avg_frame_time * 0.95f + elapsed * 0.05f;
+
+        auto instance_count = size_t{};
+        for (auto& obj : scene.instanced_objs) instance_count += obj.instances.size();
+
+        ui.fps->set_string(std::to_string(static_cast<int>(1.0f / elapsed)) + " fps, " +
+            std::to_string(1000 * avg_frame_time) + " ms, " + std::to_string(instance_count) + " instances, " +
+            std::to_string(sm.renders) + " sm renders, " +
+            std::to_string(reflection.faces_rendered) + " probe faces, " +
+            std::to_string(uniforms.stats().bytes_written) + " ubo bytes (" +
+            std::to_string(uniforms.stats().fence_waits) + " fence waits, " +
+            std::to_string(uniforms.stats().mid_frame_fences) + " mid-frame fences), " +
+            std::to_string(world_matrices.updated) + " transforms (" + std::to_string(world_matrices.cpu_ms) + " cpu ms), " +
+            std::to_string(scene.point_lights.size()) + " point lights (" + std::to_string(clustered.cpu_ms) + " cpu ms)");
+        ui.timings->set_string("gpu ms: depth " + std::to_string(timers.depth.ms) +
+            ", ssao " + std::to_string(timers.ssao.ms) + " (" + std::to_string(ssao.width) + "x" +
+            std::to_string(ssao.height) + "), blur " + std::to_string(timers.blur.ms) +
+            ", ssao compute " + std::to_string(timers.ssao_compute.ms) +
+            ", temporal " + std::to_string(timers.temporal.ms) + ", shadow mask " + std::to_string(timers.shadow_mask.ms) +
+            ", pyramid " + std::to_string(timers.pyramid.ms) + ", probes " + std::to_string(timers.probes.ms) +
+            ", lighting " + std::to_string(timers.lighting.ms));
     }
 
     void onRender() {
-        if (sm.update_required) {
-            sm_prepass();
-            update_shadow_bias_matrices();
-        }
+        if (benchmark.step >= 0) glBeginQuery(GL_TIME_ELAPSED, benchmark.query_ids[benchmark.queries_issued % 2]);
+
+        /* input events only mark the camera block, so a frame writes it once however many arrived */
+        if (transf_dirty) update_transf_ubo();
+
+        /* the shadow benchmark measures rendering the maps, not reading them from the cache */
+        if (benchmark.step >= 0 && benchmark.kind == BENCHMARK_SHADOWS) invalidate_shadow_maps();
+
+        if (sm_prepass()) update_shadow_bias_matrices();
 
+        begin_gpu_timer(timers.depth);
         depth_prepass();
-        ssao_pass();
-        blur_ssao_pass();
+        depth_resolve_pass();
+        end_gpu_timer(timers.depth);
+
+        begin_gpu_timer(timers.pyramid);
+        depth_pyramid_pass();
+        end_gpu_timer(timers.pyramid);
+
+        if (temporal.enabled) begin_temporal_frame();
+
+        ssao.result_tex_id = ssao.tex_id;
+        if (ssao.path == SSAO_PATH_COMPUTE) {
+            begin_gpu_timer(timers.ssao_compute);
+            ssao_compute_pass();
+            end_gpu_timer(timers.ssao_compute);
+
+            if (temporal.enabled) {
+                begin_gpu_timer(timers.temporal);
+                ssao.result_tex_id = temporal_filter_pass(temporal.ssao, ssao.tex_id);
+                end_gpu_timer(timers.temporal);
+            }
+        } else {
+            begin_gpu_timer(timers.ssao);
+            ssao_pass();
+            end_gpu_timer(timers.ssao);
+
+            auto blur_source_tex_id = ssao.tex_id;
+            if (temporal.enabled) {
+                begin_gpu_timer(timers.temporal);
+                blur_source_tex_id = temporal_filter_pass(temporal.ssao, ssao.tex_id);
+                end_gpu_timer(timers.temporal);
+            }
+
+            begin_gpu_timer(timers.blur);
+            blur_ssao_pass(blur_source_tex_id);
+            end_gpu_timer(timers.blur);
+        }
+
+        if (temporal.enabled) {
+            begin_gpu_timer(timers.shadow_mask);
+            shadow_mask_pass();
+            glActiveTexture(GL_TEXTURE9);
+            glBindTexture(GL_TEXTURE_2D, temporal_filter_pass(temporal.shadows, temporal.shadow_mask_tex_id));
+            glActiveTexture(GL_TEXTURE0);
+            end_gpu_timer(timers.shadow_mask);
+        }
+
+        begin_gpu_timer(timers.probes);
         reflection_pass();
+        end_gpu_timer(timers.probes);
+
+        begin_gpu_timer(timers.lighting);
         lighting_pass();
+        end_gpu_timer(timers.lighting);
+
+        resolve_scene_color();
+        if (temporal.enabled) end_temporal_frame();
+
+        if (benchmark.step >= 0) {
+            glEndQuery(GL_TIME_ELAPSED);
+            update_benchmark();
+        }
 
         draw_ui();
+        uniforms.end_frame();
     }
 };
 
 int main() {
     try {
-        opengl_application<handler> app{4, 1, 1024, 768, 4};
+        opengl_application<handler> app{4, 1, 1024, 768, 0};
         app.run();
     } catch (std::exception& e) {
         std::cerr << "exception: " << e.what() << std::endl;
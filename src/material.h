@@ -3,11 +3,15 @@
 
 #include <glm/vec4.hpp>
 
+const auto REFLECTION_PROBE = 0;
+const auto REFLECTION_SSR = 1;
+
 struct material {
     glm::vec4 diffuse;
     glm::vec4 specular;
     float shininess;
     float reflectance;
+    int reflection_mode;
 };
 
 #endif /* material_h */
@@ -3,7 +3,9 @@
 #include "ext.h"
 #include <glm/gtc/constants.hpp>
 #include <glm/detail/func_geometric.hpp>
+#include <glm/detail/func_common.hpp>
 #include <cmath>
+#include <cstddef>
 #include <vector>
 #include <fstream>
 #include <stdexcept>
@@ -48,6 +50,8 @@ mesh_data gen_sphere(const float radius, const int rings, const int sectors) {
     }
 
     auto mesh = mesh_data{GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT};
+    mesh.bounds_min = glm::vec3(-radius);
+    mesh.bounds_max = glm::vec3(radius);
 
     glGenVertexArrays(1, &mesh.vao_id);
     glBindVertexArray(mesh.vao_id);
@@ -89,6 +93,8 @@ mesh_data gen_quad(const glm::vec3 v1, const glm::vec3 v2, const glm::vec3 v3, c
     const GLushort indices[] { 0, 1, 2, 0, 2, 3 };
 
     auto mesh = mesh_data{GL_TRIANGLES, array_length(indices), GL_UNSIGNED_SHORT};
+    mesh.bounds_min = glm::min(glm::min(v1, v2), glm::min(v3, v4));
+    mesh.bounds_max = glm::max(glm::max(v1, v2), glm::max(v3, v4));
 
     glGenVertexArrays(1, &mesh.vao_id);
     glBindVertexArray(mesh.vao_id);
@@ -156,6 +162,8 @@ mesh_data gen_skybox() {
     };
 
     auto mesh = mesh_data{GL_TRIANGLES, array_length(indices), GL_UNSIGNED_SHORT};
+    mesh.bounds_min = glm::vec3(-size);
+    mesh.bounds_max = glm::vec3(size);
 
     glGenVertexArrays(1, &mesh.vao_id);
     glBindVertexArray(mesh.vao_id);
@@ -189,6 +197,11 @@ mesh_data load_mdl(const char* name) {
     in.read(reinterpret_cast<char*>(&indices[0]), hdr.num_indices * sizeof(indices.front()));
 
     auto mesh = mesh_data{GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT};
+    mesh.bounds_min = mesh.bounds_max = vertices.empty() ? glm::vec3() : vertices.front();
+    for (auto& v : vertices) {
+        mesh.bounds_min = glm::min(mesh.bounds_min, v);
+        mesh.bounds_max = glm::max(mesh.bounds_max, v);
+    }
 
     glGenVertexArrays(1, &mesh.vao_id);
     glBindVertexArray(mesh.vao_id);
@@ -211,4 +224,31 @@ mesh_data load_mdl(const char* name) {
     return mesh;
 }
 
+void set_instance_buffer(const mesh_data& mesh, const GLuint instance_vbo_id) {
+    glBindVertexArray(mesh.vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_id);
+
+    for (auto column = 0; column < 4; ++column) {
+        const auto attrib = FIRST_INSTANCE_ATTRIB + column;
+        glEnableVertexAttribArray(attrib);
+        glVertexAttribPointer(attrib, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data),
+            reinterpret_cast<void*>(offsetof(instance_data, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(attrib, 1);
+    }
+
+    const auto layer_attrib = FIRST_INSTANCE_ATTRIB + 4;
+    glEnableVertexAttribArray(layer_attrib);
+    glVertexAttribPointer(layer_attrib, 1, GL_FLOAT, GL_FALSE, sizeof(instance_data),
+        reinterpret_cast<void*>(offsetof(instance_data, layer)));
+    glVertexAttribDivisor(layer_attrib, 1);
+}
+
+void set_instance_divisor(const mesh_data& mesh, const GLuint divisor) {
+    glBindVertexArray(mesh.vao_id);
+
+    for (auto attrib = FIRST_INSTANCE_ATTRIB; attrib < FIRST_INSTANCE_ATTRIB + 5; ++attrib) {
+        glVertexAttribDivisor(attrib, divisor);
+    }
+}
+
 } /* namespace mesh */
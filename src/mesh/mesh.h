@@ -3,6 +3,7 @@
 
 #include "gl/gl_include.h"
 #include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
 
 namespace mesh {
 
@@ -12,13 +13,24 @@ struct mesh_data {
     GLenum index_type;
     GLuint vao_id;
     GLuint vbo_ids[6];
+    glm::vec3 bounds_min, bounds_max;
 };
 
+struct instance_data {
+    glm::mat4 model;
+    GLfloat layer;
+};
+
+const GLuint FIRST_INSTANCE_ATTRIB = 5;
+
 mesh_data gen_sphere(float radius, int rings, int sectors);
 mesh_data gen_quad(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, glm::vec3 v4);
 mesh_data gen_skybox();
 mesh_data load_mdl(const char* name);
 
+void set_instance_buffer(const mesh_data& mesh, GLuint instance_vbo_id);
+void set_instance_divisor(const mesh_data& mesh, GLuint divisor);
+
 } /* namespace mesh */
 
 #endif /* mesh_mesh_h */
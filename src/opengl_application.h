@@ -14,7 +14,7 @@ public:
         const int ogl_ver_major, const int ogl_ver_minor,
         const int width, const int height, const int samples = 1,
         const char* caption = ""
-    ) {
+    ) : handler{} {
         if (!glfwInit()) throw std::runtime_error{"glfwInit() failed"};
 
         glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
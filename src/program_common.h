@@ -3,11 +3,16 @@
 
 #include "gl/gl_include.h"
 
-const auto MAX_LIGHTS = 8;
-const auto FIRST_SM_TIU = GL_TEXTURE10;
+const auto MAX_LIGHTS = 32;
+const auto MAX_SHADOW_VIEWS = 32;
+const auto MAX_CASCADES = 4;
+const auto SM_TIU = GL_TEXTURE10;
+const auto SM_MOMENTS_TIU = GL_TEXTURE11;
+const auto WORLD_MATRICES_TIU = GL_TEXTURE15;
 
 const GLuint transf_binding_point = 1;
 const GLuint lights_binding_point = 2;
 const GLuint mtl_binding_point = 3;
+const GLuint cube_transf_binding_point = 4;
 
 #endif /* program_common_h */
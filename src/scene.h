@@ -4,8 +4,10 @@
 #include "material.h"
 #include "mesh/mesh.h"
 #include "lighting_program.h"
+#include "transform_hierarchy.h"
 #include "gl/gl_include.h"
 #include <glm/vec4.hpp>
+#include <map>
 #include <vector>
 
 struct scene_object {
@@ -15,25 +17,68 @@ struct scene_object {
     GLuint diffuse_tex_id;
     GLuint normal_tex_id;
     GLuint height_tex_id;
+    int node;
+    glm::vec3 bounds_min, bounds_max;
+    bool dynamic;
+    bool visible;
+    unsigned features;
 };
 
+struct instanced_object {
+    mesh::mesh_data mesh;
+    material mtl;
+    GLuint mtl_buffer_id;
+    GLuint diffuse_array_tex_id;
+    GLuint instance_buffer_id;
+    std::vector<mesh::instance_data> instances;
+    /* instance i is node first_instance_node + i, a child of node */
+    int node, first_instance_node;
+    glm::vec3 bounds_min, bounds_max;
+    bool dynamic;
+    bool visible;
+    unsigned features;
+};
+
+inline unsigned lighting_features(const scene_object& obj) {
+    return (obj.diffuse_tex_id != 0 ? LIGHTING_DIFFUSE_TEXTURED : 0) |
+        (obj.normal_tex_id != 0 ? LIGHTING_NORMAL_TEXTURED : 0) |
+        (obj.mtl.reflectance > 0 ? LIGHTING_REFLECTIVE : 0);
+}
+
+inline unsigned lighting_features(const instanced_object& obj) {
+    return (obj.diffuse_array_tex_id != 0 ? LIGHTING_DIFFUSE_TEXTURED : 0) |
+        (obj.mtl.reflectance > 0 ? LIGHTING_REFLECTIVE : 0);
+}
+
 struct light {
     glm::vec4 pos;
     glm::vec4 color;
 };
 
+struct point_light {
+    glm::vec3 pos;
+    float radius;
+    glm::vec4 color;
+};
+
 struct scene {
     std::vector<scene_object> objs;
+    std::vector<instanced_object> instanced_objs;
     std::vector<light> lights;
+    std::vector<point_light> point_lights;
+    transform_hierarchy transforms;
+
+    glm::vec3 bounds_min, bounds_max;
 
     struct {
         mesh::mesh_data mesh;
         GLuint tex_id;
-        GLuint program_id;
+        GLuint program_id, layered_program_id;
         GLuint map_loc;
+        GLuint faces_loc;
     } skybox;
 
-    lighting_program program;
+    std::map<unsigned, lighting_program> programs;
 };
 
 
@@ -0,0 +1,153 @@
+#include "transform_hierarchy.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+/* below this a part of a level is cheaper to update than to hand to another thread */
+const size_t MIN_NODES_PER_JOB = 4096;
+
+} /* namespace */
+
+int transform_hierarchy::add(const int parent, const glm::vec3& translation, const glm::quat& rotation,
+    const glm::vec3& scale) {
+
+    const auto node = size();
+    if (parent >= node) throw std::runtime_error{"transform parent must be added before its children"};
+
+    parents.push_back(parent);
+    depths.push_back(parent == NO_PARENT ? 0 : depths[parent] + 1);
+    translations.push_back(translation);
+    rotations.push_back(rotation);
+    scales.push_back(scale);
+    worlds.push_back(glm::mat4());
+    dirty.push_back(1);
+
+    any_dirty = true;
+    levels_valid = false;
+    return node;
+}
+
+int transform_hierarchy::add(const int parent, const glm::mat4& local) {
+    const auto scale = glm::vec3(glm::length(glm::vec3(local[0])), glm::length(glm::vec3(local[1])),
+        glm::length(glm::vec3(local[2])));
+
+    auto rotation = glm::mat3(local);
+    rotation[0] /= scale.x;
+    rotation[1] /= scale.y;
+    rotation[2] /= scale.z;
+
+    return add(parent, glm::vec3(local[3]), glm::quat_cast(rotation), scale);
+}
+
+void transform_hierarchy::clear() {
+    parents.clear();
+    depths.clear();
+    translations.clear();
+    rotations.clear();
+    scales.clear();
+    worlds.clear();
+    dirty.clear();
+
+    any_dirty = false;
+    levels_valid = false;
+}
+
+void transform_hierarchy::truncate(const int count) {
+    if (count >= size()) return;
+
+    parents.resize(count);
+    depths.resize(count);
+    translations.resize(count);
+    rotations.resize(count);
+    scales.resize(count);
+    worlds.resize(count);
+    dirty.resize(count);
+
+    levels_valid = false;
+}
+
+void transform_hierarchy::mark_dirty(const int node) {
+    dirty[node] = 1;
+    any_dirty = true;
+}
+
+void transform_hierarchy::set_translation(const int node, const glm::vec3& translation) {
+    translations[node] = translation;
+    mark_dirty(node);
+}
+
+void transform_hierarchy::set_rotation(const int node, const glm::quat& rotation) {
+    rotations[node] = rotation;
+    mark_dirty(node);
+}
+
+void transform_hierarchy::set_scale(const int node, const glm::vec3& scale) {
+    scales[node] = scale;
+    mark_dirty(node);
+}
+
+void transform_hierarchy::sort_levels() {
+    const auto level_count = depths.empty() ? 0 : *std::max_element(std::begin(depths), std::end(depths)) + 1;
+
+    level_begin.assign(level_count + 1, 0);
+    for (auto depth : depths) ++level_begin[depth + 1];
+    for (auto level = 0; level < level_count; ++level) level_begin[level + 1] += level_begin[level];
+
+    auto next = std::vector<size_t>(std::begin(level_begin), std::end(level_begin) - 1);
+    order.resize(parents.size());
+    for (auto node = 0; node < size(); ++node) order[next[depths[node]]++] = node;
+
+    levels_valid = true;
+}
+
+void transform_hierarchy::update_nodes(const size_t begin, const size_t end, std::pair<int, int>& changed) {
+    for (auto i = begin; i < end; ++i) {
+        const auto node = order[i];
+        const auto parent = parents[node];
+
+        if (parent != NO_PARENT && dirty[parent]) dirty[node] = 1;
+        if (!dirty[node]) continue;
+
+        auto local = glm::mat4_cast(rotations[node]);
+        local[0] *= scales[node].x;
+        local[1] *= scales[node].y;
+        local[2] *= scales[node].z;
+        local[3] = glm::vec4(translations[node], 1);
+
+        worlds[node] = parent == NO_PARENT ? local : worlds[parent] * local;
+
+        changed.first = std::min(changed.first, node);
+        changed.second = std::max(changed.second, node + 1);
+    }
+}
+
+std::pair<int, int> transform_hierarchy::update(job_system& jobs) {
+    if (!any_dirty) return { 0, 0 };
+    if (!levels_valid) sort_levels();
+
+    auto changed = std::pair<int, int>{ size(), 0 };
+
+    for (size_t level = 0; level + 1 < level_begin.size(); ++level) {
+        const auto begin = level_begin[level];
+        const auto count = level_begin[level + 1] - begin;
+
+        /* nodes of one level only read their parents, which the previous level finished */
+        auto partial = std::vector<std::pair<int, int>>((count + MIN_NODES_PER_JOB - 1) / MIN_NODES_PER_JOB, changed);
+
+        jobs.parallel_for(begin, begin + count, MIN_NODES_PER_JOB, [&] (const size_t first, const size_t last) {
+            update_nodes(first, last, partial[(first - begin) / MIN_NODES_PER_JOB]);
+        });
+
+        for (const auto& range : partial) {
+            changed.first = std::min(changed.first, range.first);
+            changed.second = std::max(changed.second, range.second);
+        }
+    }
+
+    std::fill(std::begin(dirty), std::end(dirty), 0);
+    any_dirty = false;
+
+    if (changed.first >= changed.second) return { 0, 0 };
+    return changed;
+}
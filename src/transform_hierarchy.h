@@ -0,0 +1,68 @@
+#ifndef transform_hierarchy_h
+#define transform_hierarchy_h
+
+#include "job_system.h"
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/* Local translation/rotation/scale and world matrix per node, stored as separate arrays.
+ * A parent is always added before its children, so node indices are in topological order. */
+class transform_hierarchy {
+public:
+    static const int NO_PARENT = -1;
+
+    int add(int parent, const glm::vec3& translation = glm::vec3(0),
+        const glm::quat& rotation = glm::quat(1, 0, 0, 0), const glm::vec3& scale = glm::vec3(1));
+
+    /* Splits an affine matrix without shear into translation, rotation and scale. */
+    int add(int parent, const glm::mat4& local);
+
+    void clear();
+
+    /* Removes the nodes from count on. They come after their parents, so no remaining node loses its parent. */
+    void truncate(int count);
+    int size() const { return static_cast<int>(parents.size()); }
+
+    void set_translation(int node, const glm::vec3& translation);
+    void set_rotation(int node, const glm::quat& rotation);
+    void set_scale(int node, const glm::vec3& scale);
+
+    int parent(int node) const { return parents[node]; }
+    const glm::vec3& translation(int node) const { return translations[node]; }
+    const glm::quat& rotation(int node) const { return rotations[node]; }
+    const glm::vec3& scale(int node) const { return scales[node]; }
+    const glm::mat4& world(int node) const { return worlds[node]; }
+
+    /* Contiguous, indexed by node. */
+    const std::vector<glm::mat4>& world_matrices() const { return worlds; }
+
+    /* Recomputes the world matrices of the changed nodes and their descendants, one depth level at a time.
+     * Levels with enough nodes are split into jobs. Returns the [first, last) node range holding every
+     * recomputed matrix, first == last when nothing changed. */
+    std::pair<int, int> update(job_system& jobs);
+
+private:
+    void mark_dirty(int node);
+    void sort_levels();
+    void update_nodes(size_t begin, size_t end, std::pair<int, int>& changed);
+
+    std::vector<int> parents;
+    std::vector<int> depths;
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> worlds;
+    std::vector<uint8_t> dirty;
+    bool any_dirty = false;
+
+    /* node indices sorted by depth, level d is order[level_begin[d], level_begin[d + 1]) */
+    std::vector<int> order;
+    std::vector<size_t> level_begin;
+    bool levels_valid = false;
+};
+
+#endif /* transform_hierarchy_h */
@@ -0,0 +1,95 @@
+#include "batch_math.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+/* Nanoseconds per element of the batch:: functions next to the glm loop they replace, best of several runs. */
+
+namespace {
+
+const size_t COUNT = 100000;
+const auto RUNS = 20;
+
+volatile float sink;
+
+template<typename fn>
+double best_ns_per_element(fn f) {
+    auto best = 1e30;
+    for (auto run = 0; run < RUNS; ++run) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        f();
+        const auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / COUNT);
+    }
+    return best;
+}
+
+void report(const char* name, const double glm_ns, const double batch_ns) {
+    std::printf("%-16s glm %6.2f ns  batch %6.2f ns  %5.2fx\n", name, glm_ns, batch_ns, glm_ns / batch_ns);
+}
+
+} /* namespace */
+
+int main() {
+    std::mt19937 rng{1};
+    std::uniform_real_distribution<float> dist{-2, 2};
+
+    auto a = std::vector<glm::mat4>(COUNT), b = a, out = a;
+    for (auto m : { &a, &b }) {
+        for (auto& matrix : *m) {
+            for (auto column = 0; column < 4; ++column) {
+                for (auto row = 0; row < 4; ++row) matrix[column][row] = dist(rng);
+            }
+        }
+    }
+
+    report("multiply",
+        best_ns_per_element([&] { for (size_t i = 0; i < COUNT; ++i) out[i] = a[i] * b[i]; sink = out[7][1][2]; }),
+        best_ns_per_element([&] { batch::multiply(a.data(), b.data(), out.data(), COUNT); sink = out[7][1][2]; }));
+
+    const auto left = a[0];
+    report("multiply one",
+        best_ns_per_element([&] { for (size_t i = 0; i < COUNT; ++i) out[i] = left * b[i]; sink = out[7][1][2]; }),
+        best_ns_per_element([&] { batch::multiply(left, b.data(), out.data(), COUNT); sink = out[7][1][2]; }));
+
+    report("normal_matrices",
+        best_ns_per_element([&] {
+            for (size_t i = 0; i < COUNT; ++i) out[i] = glm::mat4(glm::transpose(glm::inverse(glm::mat3(a[i]))));
+            sink = out[7][1][2];
+        }),
+        best_ns_per_element([&] { batch::normal_matrices(a.data(), out.data(), COUNT); sink = out[7][1][2]; }));
+
+    auto x = std::vector<float>(COUNT), y = x, z = x, radius = x;
+    for (size_t i = 0; i < COUNT; ++i) {
+        x[i] = 8 * dist(rng);
+        y[i] = 8 * dist(rng);
+        z[i] = 8 * dist(rng);
+        radius[i] = std::abs(dist(rng));
+    }
+    auto visible = std::vector<uint8_t>(COUNT);
+
+    const auto mvp = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 50.0f) *
+        glm::lookAt(glm::vec3(-3, 1.5f, 1), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+    const auto frustum = batch::extract_frustum(mvp);
+
+    report("cull_spheres",
+        best_ns_per_element([&] {
+            for (size_t i = 0; i < COUNT; ++i) {
+                auto inside = true;
+                for (const auto& plane : frustum.planes) {
+                    inside = inside && glm::dot(plane, glm::vec4(x[i], y[i], z[i], 1)) >= -radius[i];
+                }
+                visible[i] = inside;
+            }
+            sink = visible[7];
+        }),
+        best_ns_per_element([&] {
+            batch::cull_spheres(frustum, x.data(), y.data(), z.data(), radius.data(), COUNT, visible.data());
+            sink = visible[7];
+        }));
+}
@@ -0,0 +1,185 @@
+#include "batch_math.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+/* Compares batch:: against glm for every count up to a few SIMD blocks, so both the four-lane path and
+ * the scalar tail run, and with out aliasing the inputs. Exits with 1 if a check failed. */
+
+namespace {
+
+auto failures = 0;
+
+void check(const bool passed, const char* what, const size_t count, const size_t i) {
+    if (passed) return;
+    if (++failures <= 20) std::cerr << "FAILED " << what << " (count " << count << ", element " << i << ")\n";
+}
+
+std::mt19937 rng{1};
+
+float uniform(const float min, const float max) {
+    return std::uniform_real_distribution<float>{min, max}(rng);
+}
+
+glm::mat4 random_matrix() {
+    auto m = glm::mat4();
+    for (auto column = 0; column < 4; ++column) {
+        for (auto row = 0; row < 4; ++row) m[column][row] = uniform(-2, 2);
+    }
+    return m;
+}
+
+/* well conditioned upper 3x3, so the normal matrix error only measures the batch code */
+glm::mat4 random_transform() {
+    while (true) {
+        auto m = random_matrix();
+        m[0][3] = m[1][3] = m[2][3] = 0;
+        m[3][3] = 1;
+        if (std::abs(glm::determinant(glm::mat3(m))) > 0.5f) return m;
+    }
+}
+
+bool near(const glm::mat4& a, const glm::mat4& b, const float tolerance) {
+    for (auto column = 0; column < 4; ++column) {
+        for (auto row = 0; row < 4; ++row) {
+            const auto scale = std::max(1.0f, std::abs(b[column][row]));
+            if (std::abs(a[column][row] - b[column][row]) > tolerance * scale) return false;
+        }
+    }
+    return true;
+}
+
+const size_t COUNTS[] { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 13, 16, 17, 1003 };
+
+void test_multiply() {
+    for (const auto count : COUNTS) {
+        auto a = std::vector<glm::mat4>(count), b = std::vector<glm::mat4>(count), out = a;
+        for (size_t i = 0; i < count; ++i) {
+            a[i] = random_matrix();
+            b[i] = random_matrix();
+        }
+
+        batch::multiply(a.data(), b.data(), out.data(), count);
+        for (size_t i = 0; i < count; ++i) check(near(out[i], a[i] * b[i], 1e-5f), "multiply", count, i);
+
+        auto aliased = a;
+        batch::multiply(aliased.data(), b.data(), aliased.data(), count);
+        for (size_t i = 0; i < count; ++i) check(near(aliased[i], a[i] * b[i], 1e-5f), "multiply out == a", count, i);
+
+        aliased = b;
+        batch::multiply(a.data(), aliased.data(), aliased.data(), count);
+        for (size_t i = 0; i < count; ++i) check(near(aliased[i], a[i] * b[i], 1e-5f), "multiply out == b", count, i);
+
+        const auto left = random_matrix();
+        batch::multiply(left, b.data(), out.data(), count);
+        for (size_t i = 0; i < count; ++i) check(near(out[i], left * b[i], 1e-5f), "multiply one", count, i);
+
+        aliased = b;
+        batch::multiply(left, aliased.data(), aliased.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            check(near(aliased[i], left * b[i], 1e-5f), "multiply one out == b", count, i);
+        }
+    }
+}
+
+void test_normal_matrices() {
+    for (const auto count : COUNTS) {
+        auto m = std::vector<glm::mat4>(count), out = m;
+        for (auto& matrix : m) matrix = random_transform();
+
+        const auto expected = [&m] (const size_t i) {
+            return glm::mat4(glm::transpose(glm::inverse(glm::mat3(m[i]))));
+        };
+
+        batch::normal_matrices(m.data(), out.data(), count);
+        for (size_t i = 0; i < count; ++i) check(near(out[i], expected(i), 1e-4f), "normal_matrices", count, i);
+
+        auto aliased = m;
+        batch::normal_matrices(aliased.data(), aliased.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            check(near(aliased[i], expected(i), 1e-4f), "normal_matrices out == m", count, i);
+        }
+    }
+}
+
+glm::mat4 camera_mvp() {
+    const auto projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 50.0f);
+    return projection * glm::lookAt(glm::vec3(-3, 1.5f, 1), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+}
+
+/* signed distances to the planes of the clip volume in double, planes normalized like extract_frustum */
+void plane_distances(const glm::mat4& mvp, const glm::vec3& p, double (&distances)[6], double (&abs_normals)[6][3]) {
+    for (auto plane = 0; plane < 6; ++plane) {
+        const auto axis = plane / 2;
+        const auto sign = plane % 2 == 0 ? 1.0 : -1.0;
+
+        double coefficients[4];
+        for (auto column = 0; column < 4; ++column) {
+            coefficients[column] = double{mvp[column][3]} + sign * mvp[column][axis];
+        }
+
+        const auto length = std::sqrt(coefficients[0] * coefficients[0] + coefficients[1] * coefficients[1] +
+            coefficients[2] * coefficients[2]);
+        distances[plane] = (coefficients[0] * p.x + coefficients[1] * p.y + coefficients[2] * p.z + coefficients[3]) /
+            length;
+        for (auto i = 0; i < 3; ++i) abs_normals[plane][i] = std::abs(coefficients[i]) / length;
+    }
+}
+
+void test_culling() {
+    const auto mvp = camera_mvp();
+    const auto frustum = batch::extract_frustum(mvp);
+    const auto margin = 1e-3;
+
+    for (const auto count : COUNTS) {
+        auto x = std::vector<float>(count), y = x, z = x, radius = x;
+        auto ex = x, ey = x, ez = x;
+        for (size_t i = 0; i < count; ++i) {
+            x[i] = uniform(-8, 8);
+            y[i] = uniform(-8, 8);
+            z[i] = uniform(-8, 8);
+            radius[i] = uniform(0, 2);
+            ex[i] = uniform(0, 2);
+            ey[i] = uniform(0, 2);
+            ez[i] = uniform(0, 2);
+        }
+
+        auto spheres = std::vector<uint8_t>(count, 2), boxes = spheres;
+        batch::cull_spheres(frustum, x.data(), y.data(), z.data(), radius.data(), count, spheres.data());
+        batch::cull_aabbs(frustum, x.data(), y.data(), z.data(), ex.data(), ey.data(), ez.data(), count, boxes.data());
+
+        for (size_t i = 0; i < count; ++i) {
+            double distances[6], abs_normals[6][3];
+            plane_distances(mvp, glm::vec3(x[i], y[i], z[i]), distances, abs_normals);
+
+            auto sphere_visible = true, box_visible = true, borderline = false;
+            for (auto plane = 0; plane < 6; ++plane) {
+                const auto sphere = distances[plane] + radius[i];
+                const auto box = distances[plane] + abs_normals[plane][0] * ex[i] + abs_normals[plane][1] * ey[i] +
+                    abs_normals[plane][2] * ez[i];
+                sphere_visible = sphere_visible && sphere >= 0;
+                box_visible = box_visible && box >= 0;
+                borderline = borderline || std::abs(sphere) < margin || std::abs(box) < margin;
+            }
+            if (borderline) continue;
+
+            check(spheres[i] == (sphere_visible ? 1 : 0), "cull_spheres", count, i);
+            check(boxes[i] == (box_visible ? 1 : 0), "cull_aabbs", count, i);
+        }
+    }
+}
+
+} /* namespace */
+
+int main() {
+    test_multiply();
+    test_normal_matrices();
+    test_culling();
+
+    if (failures == 0) std::cout << "batch_math: all checks passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
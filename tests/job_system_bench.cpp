@@ -0,0 +1,47 @@
+#include "job_system.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+/* parallel_for over a compute bound loop with 1 to N threads, N being the core count (at least 4).
+ * Prints the best of several runs and the speedup over one thread. */
+
+namespace {
+
+const size_t COUNT = 1 << 20;
+const size_t GRAIN = 4096;
+const auto RUNS = 10;
+
+} /* namespace */
+
+int main() {
+    auto in = std::vector<float>(COUNT), out = in;
+    for (size_t i = 0; i < COUNT; ++i) in[i] = i * 0.001f;
+
+    const auto max_threads = std::max(4u, std::thread::hardware_concurrency());
+    std::printf("%u cores\nthreads\tms\tspeedup\n", std::thread::hardware_concurrency());
+
+    auto single_thread_ms = 0.0;
+    for (auto threads = 1u; threads <= max_threads; ++threads) {
+        job_system jobs{threads};
+
+        auto best = 1e30;
+        for (auto run = 0; run < RUNS; ++run) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            jobs.parallel_for(0, COUNT, GRAIN, [&] (const size_t first, const size_t last) {
+                for (auto i = first; i < last; ++i) {
+                    auto x = in[i];
+                    for (auto k = 0; k < 16; ++k) x = std::sin(x) + 0.5f * x;
+                    out[i] = x;
+                }
+            });
+            const auto end = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        if (threads == 1) single_thread_ms = best;
+        std::printf("%u\t%.2f\t%.2fx\n", threads, best, single_thread_ms / best);
+    }
+}
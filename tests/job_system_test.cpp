@@ -0,0 +1,146 @@
+#include "job_system.h"
+#include <atomic>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/* Stress test meant to run under ThreadSanitizer (make test builds it with -fsanitize=thread): nested
+ * parallel_for, run_after chains and a second thread submitting at the same time, for 1 to 8 threads.
+ * Counters live on the stack and die right after wait(), which catches a finish() still touching them.
+ * Throwing jobs must still finish their counters and surface in wait(). */
+
+namespace {
+
+const auto ITERATIONS = 10;
+
+std::atomic<int> failures{0};
+
+void check(const bool passed, const char* what, const unsigned threads) {
+    if (passed) return;
+    if (++failures <= 20) std::cerr << "FAILED " << what << " (" << threads << " threads)\n";
+}
+
+void nested_parallel_for(job_system& jobs, const unsigned threads) {
+    auto sums = std::vector<long>(2000);
+
+    jobs.parallel_for(0, sums.size(), 37, [&] (const size_t first, const size_t last) {
+        for (auto i = first; i < last; ++i) {
+            auto values = std::vector<int>(64);
+            jobs.parallel_for(0, values.size(), 8, [&] (const size_t begin, const size_t end) {
+                for (auto j = begin; j < end; ++j) values[j] = static_cast<int>(j);
+            });
+            sums[i] = std::accumulate(std::begin(values), std::end(values), 0L) + static_cast<long>(i);
+        }
+    });
+
+    for (size_t i = 0; i < sums.size(); ++i) check(sums[i] == 2016 + static_cast<long>(i), "parallel_for", threads);
+}
+
+void dependency_chains(job_system& jobs, const unsigned threads) {
+    job_counter first, second, third;
+    std::atomic<int> started{0};
+    auto stage = 0;
+
+    for (auto i = 0; i < 16; ++i) jobs.run(first, [&] { ++started; });
+
+    /* stage is a plain int, only the counters order the accesses to it */
+    jobs.run_after(first, second, [&] {
+        check(started == 16, "run_after waits for its dependency", threads);
+        stage = 1;
+    });
+    jobs.run_after(second, third, [&] {
+        check(stage == 1, "run_after chain", threads);
+        stage = 2;
+    });
+    jobs.run_after(first, third, [&] { check(started == 16, "second continuation", threads); });
+
+    jobs.wait(third);
+    check(stage == 2, "wait on a chain", threads);
+
+    /* a dependency that is already done starts the job right away */
+    job_counter done, after;
+    jobs.run_after(done, after, [&] { stage = 3; });
+    jobs.wait(after);
+    check(stage == 3, "run_after a finished counter", threads);
+}
+
+void concurrent_submitters(job_system& jobs, const unsigned threads) {
+    std::atomic<long> total{0};
+    const auto submit = [&] {
+        for (auto i = 0; i < 50; ++i) {
+            jobs.parallel_for(0, 1000, 10, [&] (const size_t first, const size_t last) {
+                total += static_cast<long>(last - first);
+            });
+        }
+    };
+
+    std::thread other{submit};
+    submit();
+    other.join();
+
+    check(total == 2 * 50 * 1000, "submission from two threads", threads);
+}
+
+void throwing_jobs(job_system& jobs, const unsigned threads) {
+    job_counter failed, skipped;
+    std::atomic<int> ran{0};
+    auto continued = false;
+
+    for (auto i = 0; i < 8; ++i) {
+        jobs.run(failed, [&, i] {
+            ++ran;
+            if (i == 3) throw std::runtime_error{"job"};
+        });
+    }
+    jobs.run_after(failed, skipped, [&] { continued = true; });
+
+    auto caught = false;
+    try {
+        jobs.wait(skipped);
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    check(caught, "wait rethrows the exception of a dependency", threads);
+    check(!continued, "a failed dependency skips its continuations", threads);
+
+    caught = false;
+    try {
+        jobs.wait(failed);
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    check(caught && ran == 8, "wait rethrows after every job ran", threads);
+
+    caught = false;
+    std::atomic<int> chunks{0};
+    try {
+        jobs.parallel_for(0, 100, 10, [&] (const size_t first, const size_t) {
+            ++chunks;
+            if (first == 50 || first == 90) throw std::runtime_error{"chunk"};
+        });
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    check(caught && chunks == 10, "parallel_for rethrows after every chunk ran", threads);
+}
+
+} /* namespace */
+
+int main() {
+    for (auto threads = 1u; threads <= 8; ++threads) {
+        job_system jobs{threads};
+        check(jobs.thread_count() == threads, "thread_count", threads);
+
+        for (auto i = 0; i < ITERATIONS; ++i) {
+            nested_parallel_for(jobs, threads);
+            dependency_chains(jobs, threads);
+        }
+        concurrent_submitters(jobs, threads);
+        throwing_jobs(jobs, threads);
+    }
+
+    if (failures == 0) std::cout << "job_system: all checks passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#include "transform_hierarchy.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+/* The layout of the app's stress_nodes slider: a root per 1000 nodes, the rest of the group its children.
+ * Every frame spins all roots, so every node is recomputed. Prints the best update time for 1 to N threads. */
+
+namespace {
+
+const auto NODES = 100000;
+const auto GROUP = 1000;
+const auto FRAMES = 50;
+
+} /* namespace */
+
+int main() {
+    auto h = transform_hierarchy{};
+    auto root = transform_hierarchy::NO_PARENT;
+    for (auto i = 0; i < NODES; ++i) {
+        const auto offset = static_cast<float>(i % GROUP) / GROUP;
+        if (i % GROUP == 0) root = h.add(transform_hierarchy::NO_PARENT);
+        else h.add(root, glm::vec3(offset, 0, 0), glm::angleAxis(offset, glm::vec3(0, 0, 1)));
+    }
+
+    const auto max_threads = std::max(4u, std::thread::hardware_concurrency());
+    std::printf("%d nodes, %u cores\nthreads\tms\n", NODES, std::thread::hardware_concurrency());
+
+    for (auto threads = 1u; threads <= max_threads; ++threads) {
+        job_system jobs{threads};
+
+        auto best = 1e30;
+        for (auto frame = 0; frame < FRAMES; ++frame) {
+            for (auto node = 0; node < NODES; node += GROUP) {
+                h.set_rotation(node, glm::angleAxis(0.01f * frame + node, glm::vec3(0, 1, 0)));
+            }
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            h.update(jobs);
+            const auto end = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        std::printf("%u\t%.2f\n", threads, best);
+    }
+}
@@ -0,0 +1,142 @@
+#include "transform_hierarchy.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+/* World matrices against parent * translate * rotate * scale computed with glm, the changed node range,
+ * and a level wide enough to be split into jobs. Exits with 1 if a check failed. */
+
+namespace {
+
+auto failures = 0;
+
+void check(const bool passed, const char* what) {
+    if (passed) return;
+    if (++failures <= 20) std::cerr << "FAILED " << what << "\n";
+}
+
+glm::mat4 local(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+    return glm::scale(glm::translate(glm::mat4(), translation) * glm::mat4_cast(rotation), scale);
+}
+
+bool near(const glm::mat4& a, const glm::mat4& b) {
+    for (auto column = 0; column < 4; ++column) {
+        for (auto row = 0; row < 4; ++row) {
+            if (std::abs(a[column][row] - b[column][row]) > 1e-4f * std::max(1.0f, std::abs(b[column][row]))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void test_chain(job_system& jobs) {
+    auto h = transform_hierarchy{};
+
+    const auto ra = glm::angleAxis(0.5f, glm::normalize(glm::vec3(1, 2, 3)));
+    const auto rb = glm::angleAxis(-1.2f, glm::vec3(0, 1, 0));
+    const auto a = h.add(transform_hierarchy::NO_PARENT, glm::vec3(1, 2, 3), ra, glm::vec3(2, 2, 2));
+    const auto b = h.add(a, glm::vec3(0, 1, 0), rb, glm::vec3(1, 0.5f, 1));
+    const auto c = h.add(b, glm::vec3(-1, 0, 0));
+    const auto d = h.add(transform_hierarchy::NO_PARENT, glm::vec3(5, 0, 0));
+
+    auto changed = h.update(jobs);
+    check(changed.first == 0 && changed.second == 4, "first update covers every node");
+
+    const auto world_a = local(glm::vec3(1, 2, 3), ra, glm::vec3(2, 2, 2));
+    const auto world_b = world_a * local(glm::vec3(0, 1, 0), rb, glm::vec3(1, 0.5f, 1));
+    check(near(h.world(a), world_a), "root world");
+    check(near(h.world(b), world_b), "child world");
+    check(near(h.world(c), world_b * glm::translate(glm::mat4(), glm::vec3(-1, 0, 0))), "grandchild world");
+    check(near(h.world(d), glm::translate(glm::mat4(), glm::vec3(5, 0, 0))), "second root world");
+
+    changed = h.update(jobs);
+    check(changed.first == changed.second, "nothing changed");
+
+    /* moving b recomputes b and its descendant c, but neither a nor d */
+    h.set_translation(b, glm::vec3(0, 3, 0));
+    changed = h.update(jobs);
+    check(changed.first == b && changed.second == c + 1, "changed range of a moved subtree");
+
+    const auto moved_b = world_a * local(glm::vec3(0, 3, 0), rb, glm::vec3(1, 0.5f, 1));
+    check(near(h.world(b), moved_b), "moved child world");
+    check(near(h.world(c), moved_b * glm::translate(glm::mat4(), glm::vec3(-1, 0, 0))), "moved grandchild world");
+
+    h.set_scale(a, glm::vec3(1));
+    h.set_rotation(a, glm::quat(1, 0, 0, 0));
+    changed = h.update(jobs);
+    check(changed.first == a && changed.second == c + 1, "changed range of a moved root");
+    check(near(h.world(a), glm::translate(glm::mat4(), glm::vec3(1, 2, 3))), "reset root world");
+
+    h.truncate(2);
+    check(h.size() == 2, "truncate");
+    const auto e = h.add(b, glm::vec3(0, 0, 1));
+    h.update(jobs);
+    check(near(h.world(e), h.world(b) * glm::translate(glm::mat4(), glm::vec3(0, 0, 1))), "node added after truncate");
+
+    auto threw = false;
+    try {
+        h.add(h.size());
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    check(threw, "a parent must exist before its children");
+}
+
+void test_decompose(job_system& jobs) {
+    const auto rotation = glm::angleAxis(2.0f, glm::normalize(glm::vec3(-1, 1, 0.5f)));
+    const auto matrix = local(glm::vec3(3, -2, 1), rotation, glm::vec3(0.5f, 2, 3));
+
+    auto h = transform_hierarchy{};
+    const auto node = h.add(transform_hierarchy::NO_PARENT, matrix);
+    h.update(jobs);
+    check(near(h.world(node), matrix), "add from a matrix");
+}
+
+/* 20 roots with 999 children each, the children form one level of 19980 nodes */
+void test_wide_level(job_system& jobs) {
+    const auto GROUP = 1000;
+    auto h = transform_hierarchy{};
+    auto roots = std::vector<int>{};
+
+    for (auto i = 0; i < 20 * GROUP; ++i) {
+        const auto offset = static_cast<float>(i % GROUP) / GROUP;
+        if (i % GROUP == 0) roots.push_back(h.add(transform_hierarchy::NO_PARENT));
+        else h.add(roots.back(), glm::vec3(offset, 0, 0), glm::angleAxis(offset, glm::vec3(0, 0, 1)));
+    }
+    h.update(jobs);
+
+    for (auto i = 0; i < static_cast<int>(roots.size()); ++i) {
+        h.set_rotation(roots[i], glm::angleAxis(0.1f * i, glm::vec3(0, 1, 0)));
+    }
+    const auto changed = h.update(jobs);
+    check(changed.first == 0 && changed.second == h.size(), "wide level changed range");
+
+    auto correct = true;
+    for (auto node = 0; node < h.size(); ++node) {
+        const auto parent = h.parent(node);
+        const auto parent_world = parent == transform_hierarchy::NO_PARENT ? glm::mat4() : h.world(parent);
+        const auto expected = parent_world * local(h.translation(node), h.rotation(node), h.scale(node));
+        correct = correct && near(h.world(node), expected);
+    }
+    check(correct, "wide level worlds");
+}
+
+} /* namespace */
+
+int main() {
+    for (const auto threads : { 1u, 4u }) {
+        job_system jobs{threads};
+        test_chain(jobs);
+        test_decompose(jobs);
+        test_wide_level(jobs);
+    }
+
+    if (failures == 0) std::cout << "transform_hierarchy: all checks passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}